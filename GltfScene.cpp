@@ -0,0 +1,761 @@
+#include "GltfScene.h"
+#include "Json.h"
+#include "MappedFile.h"
+#include "MeshLoader.h"
+#include "MeshTangents.h"
+#include "Parallel.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+
+namespace {
+    const uint32_t GLB_MAGIC = 0x46546C67;         // "glTF"
+    const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;    // "JSON"
+    const uint32_t GLB_CHUNK_BIN = 0x004E4942;     // "BIN\0"
+
+    // Component types are GL enums in glTF
+    const int COMPONENT_BYTE = 5120;
+    const int COMPONENT_UNSIGNED_BYTE = 5121;
+    const int COMPONENT_SHORT = 5122;
+    const int COMPONENT_UNSIGNED_SHORT = 5123;
+    const int COMPONENT_UNSIGNED_INT = 5125;
+    const int COMPONENT_FLOAT = 5126;
+
+    const int MODE_TRIANGLES = 4;
+    const int MODE_TRIANGLE_STRIP = 5;
+    const int MODE_TRIANGLE_FAN = 6;
+
+    // A direct upload may carry other data interleaved with or between the attributes,
+    // beyond this many times the bytes actually used the primitive is repacked instead
+    const size_t MAX_DIRECT_OVERHEAD = 2;
+
+    size_t componentSize(int componentType) {
+        switch (componentType) {
+            case COMPONENT_BYTE: case COMPONENT_UNSIGNED_BYTE: return 1;
+            case COMPONENT_SHORT: case COMPONENT_UNSIGNED_SHORT: return 2;
+            case COMPONENT_UNSIGNED_INT: case COMPONENT_FLOAT: return 4;
+            default: return 0;
+        }
+    }
+
+    int componentCount(const std::string &type) {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    // Non-negative JSON number as a size, 0 if missing or invalid
+    size_t sizeValue(const JsonValue &value) {
+        return value.isNumber() && value.number >= 0.0 ? (size_t)value.number : 0;
+    }
+
+    // CPU memory held by the importer, file mappings excluded since the kernel can drop their pages
+    struct MemoryUse {
+        size_t current = 0;
+        size_t peak = 0;
+
+        void add(size_t bytes) {
+            current += bytes;
+            peak = std::max(peak, current);
+        }
+        void remove(size_t bytes) { current -= std::min(bytes, current); }
+    };
+
+    struct Span {
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+    };
+
+    struct Accessor {
+        const unsigned char *data = nullptr;    // First element
+        int buffer = -1;
+        size_t offset = 0;      // Of the first element inside its buffer
+        size_t count = 0;
+        size_t stride = 0;
+        int componentType = 0;
+        int components = 0;
+        bool normalized = false;
+
+        size_t elementSize() const { return componentSize(componentType) * components; }
+        size_t span() const { return count ? (count - 1) * stride + elementSize() : 0; }
+        bool isFloat(int n) const { return componentType == COMPONENT_FLOAT && components == n; }
+
+        // Normalized integers map to [0, 1] or [-1, 1], others convert as they are
+        float read(size_t index, int component) const {
+            const unsigned char *p = data + index * stride + component * componentSize(componentType);
+            switch (componentType) {
+                case COMPONENT_FLOAT: { float v; std::memcpy(&v, p, 4); return v; }
+                case COMPONENT_BYTE: { int8_t v; std::memcpy(&v, p, 1); return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+                case COMPONENT_UNSIGNED_BYTE: return normalized ? p[0] / 255.0f : p[0];
+                case COMPONENT_SHORT: { int16_t v; std::memcpy(&v, p, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+                case COMPONENT_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return normalized ? v / 65535.0f : v; }
+                case COMPONENT_UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return (float)v; }
+                default: return 0.0f;
+            }
+        }
+
+        unsigned int readIndex(size_t index) const {
+            const unsigned char *p = data + index * stride;
+            if (componentType == COMPONENT_UNSIGNED_BYTE)
+                return p[0];
+            if (componentType == COMPONENT_UNSIGNED_SHORT) {
+                uint16_t v;
+                std::memcpy(&v, p, 2);
+                return v;
+            }
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+    };
+
+    uint32_t readUint32(const char *p) {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    std::string directoryOf(const std::string &path) {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    // Relative URIs may escape characters such as spaces
+    std::string decodeUri(const std::string &uri) {
+        std::string decoded;
+        for (size_t i = 0; i < uri.size(); i++) {
+            if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit((unsigned char)uri[i + 1])
+                && std::isxdigit((unsigned char)uri[i + 2])) {
+                decoded += (char)std::stoi(uri.substr(i + 1, 2), nullptr, 16);
+                i += 2;
+            } else {
+                decoded += uri[i];
+            }
+        }
+        return decoded;
+    }
+
+    bool decodeBase64(const char *begin, const char *end, std::vector<unsigned char> &out) {
+        auto value = [](char c) -> int {
+            if (c >= 'A' && c <= 'Z') return c - 'A';
+            if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+            if (c >= '0' && c <= '9') return c - '0' + 52;
+            if (c == '+' || c == '-') return 62;
+            if (c == '/' || c == '_') return 63;
+            return -1;
+        };
+
+        out.clear();
+        out.reserve((end - begin) / 4 * 3);
+        uint32_t bits = 0;
+        int count = 0;
+        for (const char *p = begin; p < end && *p != '='; p++) {
+            int v = value(*p);
+            if (v < 0)
+                return false;
+            bits = (bits << 6) | (uint32_t)v;
+            if (++count == 4) {
+                out.push_back((unsigned char)(bits >> 16));
+                out.push_back((unsigned char)(bits >> 8));
+                out.push_back((unsigned char)bits);
+                bits = 0;
+                count = 0;
+            }
+        }
+        if (count == 2) {
+            out.push_back((unsigned char)(bits >> 4));
+        } else if (count == 3) {
+            out.push_back((unsigned char)(bits >> 10));
+            out.push_back((unsigned char)(bits >> 2));
+        } else if (count == 1) {
+            return false;
+        }
+        return true;
+    }
+
+    // Matrix or translation, rotation and scale of a node, the rotation is a unit quaternion (x, y, z, w)
+    glm::mat4 nodeTransform(const JsonValue &node) {
+        const JsonValue &matrix = node["matrix"];
+        if (matrix.size() == 16) {
+            glm::mat4 transform(1.0f);
+            for (int column = 0; column < 4; column++)
+                for (int row = 0; row < 4; row++)
+                    transform[column][row] = (float)matrix[column * 4 + row].asNumber();
+            return transform;
+        }
+
+        const JsonValue &t = node["translation"], &r = node["rotation"], &s = node["scale"];
+        glm::vec3 translation(t.size() == 3 ? glm::vec3(t[0].asNumber(), t[1].asNumber(), t[2].asNumber()) : glm::vec3(0.0f));
+        glm::vec3 scale(s.size() == 3 ? glm::vec3(s[0].asNumber(), s[1].asNumber(), s[2].asNumber()) : glm::vec3(1.0f));
+        float x = 0.0f, y = 0.0f, z = 0.0f, w = 1.0f;
+        if (r.size() == 4) {
+            x = (float)r[0].asNumber();
+            y = (float)r[1].asNumber();
+            z = (float)r[2].asNumber();
+            w = (float)r[3].asNumber();
+        }
+
+        glm::mat4 transform(1.0f);
+        transform[0] = glm::vec4(1 - 2*(y*y + z*z), 2*(x*y + z*w), 2*(x*z - y*w), 0.0f) * scale.x;
+        transform[1] = glm::vec4(2*(x*y - z*w), 1 - 2*(x*x + z*z), 2*(y*z + x*w), 0.0f) * scale.y;
+        transform[2] = glm::vec4(2*(x*z + y*w), 2*(y*z - x*w), 1 - 2*(x*x + y*y), 0.0f) * scale.z;
+        transform[3] = glm::vec4(translation, 1.0f);
+        return transform;
+    }
+
+    // Triangle list indices of a strip or fan, glTF strips have no restarts
+    std::vector<unsigned int> triangleList(const std::vector<unsigned int> &indices, int mode) {
+        std::vector<unsigned int> list;
+        if (indices.size() < 3)
+            return list;
+        list.reserve((indices.size() - 2) * 3);
+        for (size_t i = 0; i + 2 < indices.size(); i++) {
+            if (mode == MODE_TRIANGLE_FAN) {
+                list.insert(list.end(), {indices[0], indices[i + 1], indices[i + 2]});
+            } else if (i % 2 == 0) {
+                list.insert(list.end(), {indices[i], indices[i + 1], indices[i + 2]});
+            } else {
+                list.insert(list.end(), {indices[i + 1], indices[i], indices[i + 2]});
+            }
+        }
+        return list;
+    }
+
+    // One glTF file while it is imported. Binary data stays in the file mappings or decoded
+    // data URIs until the import is done.
+    struct Document {
+        JsonValue json;
+        std::string directory;
+        std::vector<Span> buffers;
+        std::vector<std::unique_ptr<MappedFile>> files;
+        std::vector<std::vector<unsigned char>> decoded;
+        MemoryUse memory;
+        size_t fileBytes = 0;
+
+        // Mapped file or data URI contents, false if it cannot be read
+        bool resolveUri(const std::string &uri, Span &out) {
+            if (uri.compare(0, 5, "data:") == 0) {
+                size_t comma = uri.find(',');
+                if (comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos)
+                    return false;
+                decoded.emplace_back();
+                if (!decodeBase64(uri.data() + comma + 1, uri.data() + uri.size(), decoded.back()))
+                    return false;
+                memory.add(decoded.back().size());
+                out = {decoded.back().data(), decoded.back().size()};
+                return true;
+            }
+
+            files.push_back(std::make_unique<MappedFile>(directory + decodeUri(uri)));
+            if (!files.back()->data)
+                return false;
+            fileBytes += files.back()->size;
+            out = {reinterpret_cast<const unsigned char*>(files.back()->data), files.back()->size};
+            return true;
+        }
+
+        bool resolveBuffers(Span glbBinary) {
+            const JsonValue &list = json["buffers"];
+            buffers.assign(list.size(), Span());
+            for (size_t i = 0; i < list.size(); i++) {
+                const JsonValue *uri = list[i].find("uri");
+                if (!uri) {
+                    // Only the first buffer of a .glb may omit its uri, it is the binary chunk
+                    if (i != 0 || !glbBinary.data)
+                        return false;
+                    buffers[i] = glbBinary;
+                } else if (!resolveUri(uri->asString(), buffers[i])) {
+                    std::cerr << "ERROR::GLTF::BUFFER_NOT_READ " << i << std::endl;
+                    return false;
+                }
+                if (buffers[i].size < sizeValue(list[i]["byteLength"]))
+                    return false;
+            }
+            return true;
+        }
+
+        // Contents of a buffer view, empty if it lies outside its buffer
+        Span bufferView(int index, size_t *stride = nullptr, int *buffer = nullptr, size_t *offset = nullptr) const {
+            const JsonValue &view = json["bufferViews"][(size_t)index];
+            int bufferIndex = view["buffer"].asInt();
+            size_t viewOffset = sizeValue(view["byteOffset"]), length = sizeValue(view["byteLength"]);
+            if (bufferIndex < 0 || (size_t)bufferIndex >= buffers.size() || viewOffset + length > buffers[bufferIndex].size)
+                return Span();
+            if (stride)
+                *stride = sizeValue(view["byteStride"]);
+            if (buffer)
+                *buffer = bufferIndex;
+            if (offset)
+                *offset = viewOffset;
+            return {buffers[bufferIndex].data + viewOffset, length};
+        }
+
+        // Sparse accessors and accessors without a buffer view are not supported
+        bool accessor(int index, Accessor &out) const {
+            const JsonValue &accessor = json["accessors"][(size_t)index];
+            if (!accessor.isObject() || accessor.find("sparse") || !accessor.find("bufferView"))
+                return false;
+
+            out.count = sizeValue(accessor["count"]);
+            out.componentType = accessor["componentType"].asInt(0);
+            out.components = componentCount(accessor["type"].asString());
+            out.normalized = accessor["normalized"].asBool();
+            if (out.count == 0 || out.elementSize() == 0)
+                return false;
+
+            size_t viewStride = 0, viewOffset = 0;
+            Span view = bufferView(accessor["bufferView"].asInt(), &viewStride, &out.buffer, &viewOffset);
+            size_t accessorOffset = sizeValue(accessor["byteOffset"]);
+            out.stride = viewStride ? viewStride : out.elementSize();
+            if (!view.data || accessorOffset + out.span() > view.size)
+                return false;
+
+            out.offset = viewOffset + accessorOffset;
+            out.data = view.data + accessorOffset;
+            return true;
+        }
+
+        // Position bounds from the accessor's min and max, which glTF requires, or from the data
+        static void positionBounds(const JsonValue &json, const Accessor &positions, glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+            const JsonValue &min = json["min"], &max = json["max"];
+            if (min.size() == 3 && max.size() == 3) {
+                boundsMin = glm::vec3(min[0].asNumber(), min[1].asNumber(), min[2].asNumber());
+                boundsMax = glm::vec3(max[0].asNumber(), max[1].asNumber(), max[2].asNumber());
+                return;
+            }
+            boundsMin = glm::vec3(std::numeric_limits<float>::max());
+            boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+            for (size_t i = 0; i < positions.count; i++) {
+                glm::vec3 position(positions.read(i, 0), positions.read(i, 1), positions.read(i, 2));
+                boundsMin = glm::min(boundsMin, position);
+                boundsMax = glm::max(boundsMax, position);
+            }
+        }
+
+        // Fills mesh from one primitive, false if the primitive is skipped. Primitives whose material
+        // has a normal map get tangents, generated when the file has none
+        bool primitive(const JsonValue &primitive, VertexFormat format, bool needsTangents, Mesh &mesh, bool &direct,
+                       glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+            int mode = primitive["mode"].asInt(MODE_TRIANGLES);
+            if (mode != MODE_TRIANGLES && mode != MODE_TRIANGLE_STRIP && mode != MODE_TRIANGLE_FAN)
+                return false;
+
+            const JsonValue &attributes = primitive["attributes"];
+            Accessor positions, normals, texCoords, tangents, indices;
+            if (!accessor(attributes["POSITION"].asInt(), positions) || positions.components != 3)
+                return false;
+            bool hasNormals = attributes.find("NORMAL") && accessor(attributes["NORMAL"].asInt(), normals)
+                              && normals.components == 3 && normals.count >= positions.count;
+            bool hasTexCoords = attributes.find("TEXCOORD_0") && accessor(attributes["TEXCOORD_0"].asInt(), texCoords)
+                                && texCoords.components == 2 && texCoords.count >= positions.count;
+            bool hasTangents = needsTangents && hasNormals && attributes.find("TANGENT")
+                               && accessor(attributes["TANGENT"].asInt(), tangents)
+                               && tangents.isFloat(4) && tangents.count >= positions.count;
+            bool hasIndices = primitive.find("indices");
+            if (hasIndices) {
+                if (!accessor(primitive["indices"].asInt(), indices) || indices.components != 1
+                    || indices.componentType == COMPONENT_BYTE || indices.componentType == COMPONENT_SHORT
+                    || indices.componentType == COMPONENT_FLOAT)
+                    return false;
+                // Out of range indices would read past the vertex buffer on the GPU
+                for (size_t i = 0; i < indices.count; i++)
+                    if (indices.readIndex(i) >= positions.count)
+                        return false;
+            }
+            positionBounds(json["accessors"][(size_t)attributes["POSITION"].asInt()], positions, boundsMin, boundsMax);
+
+            // The vertex buffer is the byte range covering every attribute, uploaded as it is
+            size_t lo = positions.offset, hi = positions.offset + positions.span();
+            size_t used = positions.count * positions.elementSize();
+            for (const Accessor *attribute : {&normals, &texCoords, &tangents}) {
+                if (!attribute->data)
+                    continue;
+                lo = std::min(lo, attribute->offset);
+                hi = std::max(hi, attribute->offset + attribute->span());
+                used += positions.count * attribute->elementSize();
+            }
+            direct = format == VertexFormat::Float && mode == MODE_TRIANGLES
+                     && positions.isFloat(3) && hasNormals && normals.isFloat(3) && normals.buffer == positions.buffer
+                     && (!hasTexCoords || (texCoords.isFloat(2) && texCoords.buffer == positions.buffer))
+                     && (!needsTangents || (hasTangents && tangents.buffer == positions.buffer))
+                     && (!hasIndices || indices.stride == indices.elementSize())
+                     && hi - lo <= used * MAX_DIRECT_OVERHEAD;
+
+            if (direct) {
+                EncodedMesh encoded;
+                encoded.vertexData = buffers[positions.buffer].data + lo;
+                encoded.vertexBytes = hi - lo;
+                encoded.customLayout = true;
+                encoded.position = {true, positions.offset - lo, (int)positions.stride};
+                encoded.normal = {true, normals.offset - lo, (int)normals.stride};
+                if (hasTexCoords)
+                    encoded.texCoords = {true, texCoords.offset - lo, (int)texCoords.stride};
+                if (hasTangents)
+                    encoded.tangent = {true, tangents.offset - lo, (int)tangents.stride};
+
+                // Non-indexed primitives get a sequential element buffer, Mesh always draws indexed
+                std::vector<unsigned int> sequence;
+                if (hasIndices) {
+                    encoded.indexType = (GLenum)indices.componentType;
+                    encoded.indexData = indices.data;
+                    encoded.indexCount = indices.count;
+                } else {
+                    sequence.resize(positions.count);
+                    for (size_t i = 0; i < sequence.size(); i++)
+                        sequence[i] = (unsigned int)i;
+                    memory.add(sequence.size() * sizeof(unsigned int));
+                    encoded.indexData = sequence.data();
+                    encoded.indexCount = sequence.size();
+                }
+                mesh.upload(encoded);
+                memory.remove(sequence.size() * sizeof(unsigned int));
+                return true;
+            }
+
+            MeshData data;
+            data.vertices.resize(positions.count);
+            parallelFor(positions.count, 1 << 14, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    Vertex &vertex = data.vertices[i];
+                    vertex.position = glm::vec3(positions.read(i, 0), positions.read(i, 1), positions.read(i, 2));
+                    vertex.normal = hasNormals ? glm::vec3(normals.read(i, 0), normals.read(i, 1), normals.read(i, 2))
+                                               : glm::vec3(0.0f, 1.0f, 0.0f);
+                    vertex.texCoords = hasTexCoords ? glm::vec2(texCoords.read(i, 0), texCoords.read(i, 1)) : glm::vec2(0.0f);
+                    if (hasTangents)
+                        vertex.tangent = glm::vec4(tangents.read(i, 0), tangents.read(i, 1), tangents.read(i, 2), tangents.read(i, 3));
+                }
+            });
+            data.indices.resize(hasIndices ? indices.count : positions.count);
+            for (size_t i = 0; i < data.indices.size(); i++)
+                data.indices[i] = hasIndices ? indices.readIndex(i) : (unsigned int)i;
+            if (mode != MODE_TRIANGLES)
+                data.indices = triangleList(data.indices, mode);
+            if (!hasNormals)
+                computeNormals(data);
+            data.tangents = hasTangents;
+            if (needsTangents && !hasTangents && hasTexCoords)
+                computeTangents(data);
+
+            // Repacked meshes keep their CPU copy, it stays counted
+            memory.add(data.vertices.size() * sizeof(Vertex) + data.indices.size() * sizeof(unsigned int));
+            mesh.upload(std::move(data), format);
+            return true;
+        }
+    };
+
+    GLenum wrapMode(int mode) {
+        return mode == GL_CLAMP_TO_EDGE || mode == GL_MIRRORED_REPEAT ? (GLenum)mode : GL_REPEAT;
+    }
+
+    bool mipmapped(int filter) {
+        return filter != GL_NEAREST && filter != GL_LINEAR;
+    }
+}
+
+GltfScene::~GltfScene() {
+    clear();
+}
+
+void GltfScene::clear() {
+    for (unsigned int texture : textures)
+        if (texture)
+            glDeleteTextures(1, &texture);
+    textures.clear();
+    meshes.clear();
+    materials.clear();
+    draws.clear();
+}
+
+bool GltfScene::load(const std::string &path, VertexFormat format, GltfStats *stats) {
+    auto start = std::chrono::steady_clock::now();
+    clear();
+
+    MappedFile file(path);
+    if (!file.data) {
+        std::cerr << "ERROR::GLTF::FILE_NOT_READ " << path << std::endl;
+        return false;
+    }
+
+    Document document;
+    document.directory = directoryOf(path);
+    document.fileBytes = file.size;
+
+    // A .glb holds the JSON chunk and optionally one binary chunk, a .gltf is the JSON itself
+    const char *jsonBegin = file.data, *jsonEnd = file.data + file.size;
+    Span glbBinary;
+    if (file.size >= 12 && readUint32(file.data) == GLB_MAGIC) {
+        size_t length = std::min<size_t>(readUint32(file.data + 8), file.size);
+        jsonBegin = jsonEnd = nullptr;
+        for (size_t offset = 12; offset + 8 <= length;) {
+            size_t chunkLength = readUint32(file.data + offset);
+            uint32_t chunkType = readUint32(file.data + offset + 4);
+            const char *chunk = file.data + offset + 8;
+            if (chunkLength > length - offset - 8)
+                break;
+            if (chunkType == GLB_CHUNK_JSON && !jsonBegin) {
+                jsonBegin = chunk;
+                jsonEnd = chunk + chunkLength;
+            } else if (chunkType == GLB_CHUNK_BIN && !glbBinary.data) {
+                glbBinary = {reinterpret_cast<const unsigned char*>(chunk), chunkLength};
+            }
+            offset += 8 + ((chunkLength + 3) & ~(size_t)3);
+        }
+        if (!jsonBegin) {
+            std::cerr << "ERROR::GLTF::NO_JSON_CHUNK " << path << std::endl;
+            return false;
+        }
+    }
+
+    std::string error;
+    if (!JsonValue::parse(jsonBegin, jsonEnd, document.json, error)) {
+        std::cerr << "ERROR::GLTF::INVALID_JSON " << path << ": " << error << std::endl;
+        return false;
+    }
+    const JsonValue &json = document.json;
+    if (json["asset"]["version"].asString().compare(0, 2, "2.") != 0) {
+        std::cerr << "ERROR::GLTF::UNSUPPORTED_VERSION " << path << std::endl;
+        return false;
+    }
+    if (!document.resolveBuffers(glbBinary))
+        return false;
+
+    // Images are decoded in parallel, then uploaded here on the GL thread
+    const JsonValue &images = json["images"];
+    std::vector<Span> sources(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        const JsonValue &image = images[i];
+        if (const JsonValue *uri = image.find("uri"))
+            document.resolveUri(uri->asString(), sources[i]);
+        else if (image.find("bufferView"))
+            sources[i] = document.bufferView(image["bufferView"].asInt());
+    }
+
+    struct Pixels {
+        unsigned char *data = nullptr;
+        int width = 0;
+        int height = 0;
+    };
+    std::vector<Pixels> pixels(images.size());
+    parallelFor(images.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            int components;
+            if (sources[i].data && sources[i].size <= (size_t)std::numeric_limits<int>::max())
+                pixels[i].data = stbi_load_from_memory(sources[i].data, (int)sources[i].size,
+                                                       &pixels[i].width, &pixels[i].height, &components, 4);
+        }
+    });
+    for (const Pixels &image : pixels)
+        document.memory.add((size_t)image.width * image.height * 4);
+
+    size_t textureBytes = 0;
+    const JsonValue &textureList = json["textures"];
+    std::vector<unsigned int> imageTextures(images.size(), 0);
+    textures.assign(textureList.size(), 0);
+    for (size_t i = 0; i < textureList.size(); i++) {
+        int source = textureList[i]["source"].asInt();
+        if (source < 0 || (size_t)source >= images.size() || !pixels[source].data) {
+            std::cerr << "ERROR::GLTF::TEXTURE_NOT_LOADED " << i << std::endl;
+            continue;
+        }
+
+        const JsonValue &sampler = json["samplers"][(size_t)textureList[i]["sampler"].asInt()];
+        int minFilter = sampler["minFilter"].asInt(GL_LINEAR_MIPMAP_LINEAR);
+        int magFilter = sampler["magFilter"].asInt(GL_LINEAR);
+
+        glGenTextures(1, &textures[i]);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, pixels[source].width, pixels[source].height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, pixels[source].data);
+        size_t bytes = (size_t)pixels[source].width * pixels[source].height * 4;
+        if (mipmapped(minFilter)) {
+            glGenerateMipmap(GL_TEXTURE_2D);
+            bytes += bytes / 3;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode(sampler["wrapS"].asInt(GL_REPEAT)));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode(sampler["wrapT"].asInt(GL_REPEAT)));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter == GL_NEAREST ? GL_NEAREST : GL_LINEAR);
+        textureBytes += bytes;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    for (size_t i = 0; i < images.size(); i++) {
+        document.fileBytes += sources[i].size;
+        if (pixels[i].data) {
+            stbi_image_free(pixels[i].data);
+            document.memory.remove((size_t)pixels[i].width * pixels[i].height * 4);
+        }
+    }
+
+    auto textureIndex = [&](const JsonValue &info) {
+        int index = info["index"].asInt();
+        return index >= 0 && (size_t)index < textures.size() ? index : -1;
+    };
+    for (const JsonValue &source : json["materials"].array) {
+        const JsonValue &pbr = source["pbrMetallicRoughness"];
+        GltfMaterial material;
+        const JsonValue &factor = pbr["baseColorFactor"];
+        if (factor.size() == 4)
+            material.baseColor = glm::vec4(factor[0].asNumber(), factor[1].asNumber(), factor[2].asNumber(), factor[3].asNumber());
+        material.metallic = (float)pbr["metallicFactor"].asNumber(1.0);
+        material.roughness = (float)pbr["roughnessFactor"].asNumber(1.0);
+        material.baseColorTexture = textureIndex(pbr["baseColorTexture"]);
+        material.metallicRoughnessTexture = textureIndex(pbr["metallicRoughnessTexture"]);
+        material.normalTexture = textureIndex(source["normalTexture"]);
+        materials.push_back(material);
+    }
+
+    // Meshes are built the first time a node uses them, each primitive becomes one Mesh
+    struct Primitive {
+        int mesh;
+        int material;
+    };
+    const JsonValue &meshList = json["meshes"];
+    std::vector<std::vector<Primitive>> meshPrimitives(meshList.size());
+    std::vector<bool> built(meshList.size(), false);
+    std::vector<std::pair<glm::vec3, glm::vec3>> localBounds;
+    size_t primitives = 0, directPrimitives = 0, skippedPrimitives = 0, triangles = 0;
+
+    auto buildMesh = [&](size_t index) {
+        built[index] = true;
+        for (const JsonValue &primitive : meshList[index]["primitives"].array) {
+            primitives++;
+            meshes.emplace_back(MeshData());
+            int material = primitive["material"].asInt();
+            if ((size_t)material >= materials.size())
+                material = -1;
+            bool needsTangents = material >= 0 && materials[material].normalTexture >= 0;
+            bool direct = false;
+            glm::vec3 boundsMin, boundsMax;
+            if (!document.primitive(primitive, format, needsTangents, meshes.back(), direct, boundsMin, boundsMax)) {
+                meshes.pop_back();
+                skippedPrimitives++;
+                continue;
+            }
+            directPrimitives += direct;
+            triangles += meshes.back().triangleCount();
+            localBounds.emplace_back(boundsMin, boundsMax);
+            meshPrimitives[index].push_back({(int)meshes.size() - 1, material});
+        }
+    };
+
+    glm::vec3 sceneMin(std::numeric_limits<float>::max()), sceneMax(-std::numeric_limits<float>::max());
+    const JsonValue &nodes = json["nodes"];
+    std::function<void(size_t, const glm::mat4&, size_t)> visit = [&](size_t index, const glm::mat4 &parent, size_t depth) {
+        // glTF forbids cycles, a hierarchy deeper than the node count has one
+        if (index >= nodes.size() || depth > nodes.size())
+            return;
+        const JsonValue &node = nodes[index];
+        glm::mat4 transform = parent * nodeTransform(node);
+
+        int mesh = node["mesh"].asInt();
+        if (mesh >= 0 && (size_t)mesh < meshList.size()) {
+            if (!built[mesh])
+                buildMesh(mesh);
+            for (const Primitive &primitive : meshPrimitives[mesh]) {
+                const auto &[localMin, localMax] = localBounds[primitive.mesh];
+                draws.push_back({primitive.mesh, primitive.material, transform, localMin, localMax});
+                for (int corner = 0; corner < 8; corner++) {
+                    glm::vec3 point(corner & 1 ? localMax.x : localMin.x, corner & 2 ? localMax.y : localMin.y,
+                                    corner & 4 ? localMax.z : localMin.z);
+                    glm::vec3 world(transform * glm::vec4(point, 1.0f));
+                    sceneMin = glm::min(sceneMin, world);
+                    sceneMax = glm::max(sceneMax, world);
+                }
+            }
+        }
+        for (const JsonValue &child : node["children"].array)
+            visit(sizeValue(child), transform, depth + 1);
+    };
+
+    // The default scene's roots, or every node that is nobody's child if the file has no scenes
+    const JsonValue &scenes = json["scenes"];
+    std::vector<size_t> roots;
+    if (scenes.size() > 0) {
+        for (const JsonValue &root : scenes[sizeValue(json["scene"])]["nodes"].array)
+            roots.push_back(sizeValue(root));
+    } else {
+        std::vector<bool> child(nodes.size(), false);
+        for (const JsonValue &node : nodes.array)
+            for (const JsonValue &index : node["children"].array)
+                if (sizeValue(index) < child.size())
+                    child[sizeValue(index)] = true;
+        for (size_t i = 0; i < nodes.size(); i++)
+            if (!child[i])
+                roots.push_back(i);
+    }
+    for (size_t root : roots)
+        visit(root, glm::mat4(1.0f), 0);
+
+    if (stats) {
+        *stats = GltfStats();
+        stats->fileBytes = document.fileBytes;
+        stats->peakBytes = document.memory.peak;
+        stats->gpuBytes = textureBytes;
+        for (const Mesh &mesh : meshes)
+            stats->gpuBytes += mesh.gpuSize();
+        stats->primitives = primitives;
+        stats->directPrimitives = directPrimitives;
+        stats->skippedPrimitives = skippedPrimitives;
+        stats->triangles = triangles;
+        stats->textures = textures.size() - std::count(textures.begin(), textures.end(), 0u);
+        if (!draws.empty()) {
+            stats->boundsMin = sceneMin;
+            stats->boundsMax = sceneMax;
+        }
+        stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (draws.empty()) {
+        std::cerr << "ERROR::GLTF::NOTHING_TO_DRAW " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const GltfMaterial& GltfScene::material(int index) const {
+    return index >= 0 && (size_t)index < materials.size() ? materials[index] : defaultMaterial;
+}
+
+ShaderDefines GltfScene::defines(const GltfMaterial &material) const {
+    auto loaded = [&](int texture) { return texture >= 0 && textures[texture] != 0; };
+    ShaderDefines defines;
+    if (loaded(material.baseColorTexture))
+        defines["ALBEDO_MAP"] = "";
+    if (loaded(material.metallicRoughnessTexture))
+        defines["METALLIC_ROUGHNESS_MAP"] = "";
+    if (loaded(material.normalTexture))
+        defines["NORMAL_MAP"] = "";
+    return defines;
+}
+
+void GltfScene::applyMaterial(Shader &shader, const GltfMaterial &material) const {
+    static const UniformHandle albedoHandle = Shader::handle("material.albedo");
+    static const UniformHandle metallicHandle = Shader::handle("material.metallic");
+    static const UniformHandle roughnessHandle = Shader::handle("material.roughness");
+    static const UniformHandle mapHandles[3] = {Shader::handle("albedoMap"), Shader::handle("metallicRoughnessMap"),
+                                                Shader::handle("normalMap")};
+
+    shader.setVec3(albedoHandle, glm::vec3(material.baseColor));
+    shader.setFloat(metallicHandle, material.metallic);
+    shader.setFloat(roughnessHandle, material.roughness);
+
+    const int maps[3] = {material.baseColorTexture, material.metallicRoughnessTexture, material.normalTexture};
+    for (int unit = 0; unit < 3; unit++) {
+        if (maps[unit] < 0 || !textures[maps[unit]] || !shader.active(mapHandles[unit]))
+            continue;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, textures[maps[unit]]);
+        shader.setInt(mapHandles[unit], unit);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
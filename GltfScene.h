@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "Shader.h"
+
+// glTF metallic-roughness material, the factors scale the maps as in the specification
+struct GltfMaterial {
+    glm::vec4 baseColor = glm::vec4(1.0f);
+    float metallic = 1.0f;
+    float roughness = 1.0f;
+    int baseColorTexture = -1;          // Indices into GltfScene::textures, -1 if unused
+    int metallicRoughnessTexture = -1;  // Roughness in green, metallic in blue
+    int normalTexture = -1;
+};
+
+// One primitive placed in the scene by a node
+struct GltfDraw {
+    int mesh;           // Index into GltfScene::meshes
+    int material;       // Index into GltfScene::materials, -1 for the default material
+    glm::mat4 transform;
+    glm::vec3 boundsMin;    // Bounds of the mesh before the transform
+    glm::vec3 boundsMax;
+};
+
+struct GltfStats {
+    double milliseconds = 0.0;
+    size_t fileBytes = 0;           // JSON, binary buffers and images read
+    size_t peakBytes = 0;           // Most CPU memory the importer held at once, file mappings not included
+    size_t gpuBytes = 0;            // Vertex, index and texture storage created
+    size_t primitives = 0;
+    size_t directPrimitives = 0;    // Uploaded straight from the buffer views
+    size_t skippedPrimitives = 0;   // Points, lines or invalid accessors
+    size_t triangles = 0;
+    size_t textures = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);     // World space bounds of every draw
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+/*
+ * glTF 2.0 scene importer for .gltf files with external or embedded buffers
+ * and for .glb containers. Binary buffers are memory-mapped and, when a
+ * primitive's float attributes lie in one buffer and the requested vertex
+ * format is Float, the covered byte range is uploaded as the vertex buffer as
+ * it is, with the attribute offsets and strides of the accessors. Index views
+ * are uploaded the same way. Other primitives are repacked into MeshData.
+ *
+ * Node hierarchies are flattened into draws with world transforms. Materials
+ * map onto shaders/PBRfragment.glsl, see defines() and applyMaterial().
+ *
+ * */
+
+class GltfScene {
+public:
+    GltfScene() = default;
+    ~GltfScene();
+
+    GltfScene(const GltfScene&) = delete;
+    GltfScene& operator=(const GltfScene&) = delete;
+
+    // Replaces the scene, false with an error on the console if the file cannot be read
+    bool load(const std::string &path, VertexFormat format = VertexFormat::Float, GltfStats *stats = nullptr);
+    void clear();
+    bool empty() const { return draws.empty(); }
+
+    const GltfMaterial& material(int index) const;
+    // ALBEDO_MAP, METALLIC_ROUGHNESS_MAP and NORMAL_MAP for the maps a material uses
+    ShaderDefines defines(const GltfMaterial &material) const;
+    // Sets the material factors and binds its maps to texture units 0 to 2
+    void applyMaterial(Shader &shader, const GltfMaterial &material) const;
+
+    std::vector<Mesh> meshes;               // One per glTF primitive
+    std::vector<GltfMaterial> materials;
+    std::vector<unsigned int> textures;     // GL texture per glTF texture, 0 if its image failed to load
+    std::vector<GltfDraw> draws;
+
+private:
+    GltfMaterial defaultMaterial;
+};
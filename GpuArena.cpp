@@ -0,0 +1,246 @@
+#include "GpuArena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <tuple>
+
+namespace {
+    // Blocks are allocated in whole pages of this size
+    const size_t BLOCK_GRANULARITY = 64 << 10;
+
+    size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    GLenum target(GpuPool pool) {
+        return pool == GpuPool::Vertex ? GL_ARRAY_BUFFER : GL_ELEMENT_ARRAY_BUFFER;
+    }
+}
+
+GpuArena& GpuArena::instance() {
+    static GpuArena arena;
+    return arena;
+}
+
+void GpuArena::shutdown() {
+    for (auto &[key, vertexArray] : vertexArrays)
+        glDeleteVertexArrays(1, &vertexArray);
+    vertexArrays.clear();
+    // Retired ranges still count as live in their blocks, the driver keeps deleted buffers alive for the GPU
+    for (RetiredFrame &frame : retired) {
+        glDeleteSync(frame.fence);
+        for (const GpuRange &range : frame.ranges)
+            recycle(range);
+    }
+    retired.clear();
+    for (const GpuRange &range : retiring)
+        recycle(range);
+    retiring.clear();
+    for (Pool &pool : pools) {
+        for (Block &block : pool.blocks) {
+            assert(block.liveRanges == 0 && "GpuArena::shutdown() while meshes still own ranges");
+            if (block.buffer)
+                glDeleteBuffers(1, &block.buffer);
+        }
+        pool.blocks.clear();
+        pool.retiredBytes = 0;
+    }
+}
+
+bool GpuArena::VertexArrayKey::operator<(const VertexArrayKey &other) const {
+    return std::tie(formatKey, vertexBlock, indexBlock) < std::tie(other.formatKey, other.vertexBlock, other.indexBlock);
+}
+
+GpuRange GpuArena::allocate(GpuPool poolType, size_t size, size_t alignment) {
+    GpuRange range;
+    range.pool = poolType;
+    if (size == 0)
+        return range;
+
+    Pool &pool = this->pool(poolType);
+    size_t offset = 0;
+    for (size_t i = 0; i < pool.blocks.size() && !range.valid(); i++)
+        if (pool.blocks[i].buffer && allocateIn(pool.blocks[i], size, alignment, offset))
+            range.block = (int)i;
+
+    if (!range.valid()) {
+        range.block = addBlock(poolType, std::max(BLOCK_BYTES, alignUp(size, BLOCK_GRANULARITY)));
+        allocateIn(pool.blocks[range.block], size, alignment, offset);
+    }
+
+    Block &block = pool.blocks[range.block];
+    block.used += size;
+    block.liveRanges++;
+    pool.allocations++;
+    range.offset = offset;
+    range.size = size;
+    return range;
+}
+
+void GpuArena::free(GpuRange &range) {
+    if (!range.valid())
+        return;
+    retiring.push_back(range);
+    pool(range.pool).retiredBytes += range.size;
+    range = GpuRange{range.pool};
+}
+
+unsigned int GpuArena::buffer(const GpuRange &range) const {
+    return range.valid() ? pool(range.pool).blocks[range.block].buffer : 0;
+}
+
+unsigned int GpuArena::vertexArray(int formatKey, const GpuRange &vertices, const GpuRange &indices, bool &created) {
+    VertexArrayKey key{formatKey, vertices.block, indices.block};
+    auto found = vertexArrays.find(key);
+    created = found == vertexArrays.end();
+    if (!created)
+        return found->second;
+
+    unsigned int vertexArray;
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer(vertices));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer(indices));
+    vertexArrays[key] = vertexArray;
+    return vertexArray;
+}
+
+void GpuArena::endFrame() {
+    if (!retiring.empty()) {
+        RetiredFrame frame;
+        frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        frame.ranges = std::move(retiring);
+        retiring.clear();
+        retired.push_back(std::move(frame));
+    }
+
+    // Fences complete in order, checking them never blocks
+    while (!retired.empty()) {
+        GLenum status = glClientWaitSync(retired.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(retired.front().fence);
+        for (const GpuRange &range : retired.front().ranges)
+            recycle(range);
+        retired.pop_front();
+    }
+}
+
+GpuArenaStats GpuArena::stats(GpuPool poolType) const {
+    const Pool &pool = this->pool(poolType);
+    GpuArenaStats stats;
+    stats.allocations = pool.allocations;
+    stats.blockAllocations = pool.blockAllocations;
+    stats.retiredBytes = pool.retiredBytes;
+    for (const Block &block : pool.blocks) {
+        if (!block.buffer)
+            continue;
+        stats.blocks++;
+        stats.reservedBytes += block.size;
+        stats.usedBytes += block.used;
+        stats.liveRanges += block.liveRanges;
+        stats.freeRanges += block.freeByOffset.size();
+        for (const auto &[offset, size] : block.freeByOffset)
+            stats.freeBytes += size;
+        if (!block.freeBySize.empty())
+            stats.largestFree = std::max(stats.largestFree, block.freeBySize.rbegin()->first);
+    }
+    // Retired ranges are neither used nor free yet
+    stats.usedBytes -= std::min(stats.usedBytes, stats.retiredBytes);
+    return stats;
+}
+
+int GpuArena::addBlock(GpuPool poolType, size_t size) {
+    Pool &pool = this->pool(poolType);
+    auto slot = std::find_if(pool.blocks.begin(), pool.blocks.end(), [](const Block &block) { return block.buffer == 0; });
+    if (slot == pool.blocks.end())
+        slot = pool.blocks.insert(pool.blocks.end(), Block());
+
+    Block &block = *slot;
+    block = Block();
+    block.size = size;
+    glGenBuffers(1, &block.buffer);
+    // The element buffer binding belongs to the vertex array, so none may be bound while it is set
+    glBindVertexArray(0);
+    glBindBuffer(target(poolType), block.buffer);
+    glBufferData(target(poolType), size, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(target(poolType), 0);
+    insertFree(block, 0, size);
+    pool.blockAllocations++;
+    return (int)(slot - pool.blocks.begin());
+}
+
+// Best fit: the smallest free range that still holds size after aligning its start
+bool GpuArena::allocateIn(Block &block, size_t size, size_t alignment, size_t &offset) {
+    for (auto candidate = block.freeBySize.lower_bound(size); candidate != block.freeBySize.end(); ++candidate) {
+        size_t rangeOffset = candidate->second, rangeSize = candidate->first;
+        size_t aligned = alignUp(rangeOffset, alignment);
+        if (aligned + size > rangeOffset + rangeSize)
+            continue;
+
+        eraseFree(block, block.freeByOffset.find(rangeOffset));
+        if (aligned > rangeOffset)
+            insertFree(block, rangeOffset, aligned - rangeOffset);
+        if (aligned + size < rangeOffset + rangeSize)
+            insertFree(block, aligned + size, rangeOffset + rangeSize - aligned - size);
+        offset = aligned;
+        return true;
+    }
+    return false;
+}
+
+void GpuArena::insertFree(Block &block, size_t offset, size_t size) {
+    block.freeByOffset[offset] = size;
+    block.freeBySize.emplace(size, offset);
+}
+
+void GpuArena::eraseFree(Block &block, std::map<size_t, size_t>::iterator range) {
+    auto [first, last] = block.freeBySize.equal_range(range->second);
+    for (auto it = first; it != last; ++it)
+        if (it->second == range->first) {
+            block.freeBySize.erase(it);
+            break;
+        }
+    block.freeByOffset.erase(range);
+}
+
+// Returns a retired range to the free list, merged with the free ranges next to it
+void GpuArena::recycle(const GpuRange &range) {
+    Pool &pool = this->pool(range.pool);
+    Block &block = pool.blocks[range.block];
+    pool.retiredBytes -= range.size;
+    block.used -= range.size;
+    block.liveRanges--;
+
+    size_t offset = range.offset, size = range.size;
+    auto next = block.freeByOffset.lower_bound(offset);
+    if (next != block.freeByOffset.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            eraseFree(block, previous);
+        }
+    }
+    next = block.freeByOffset.lower_bound(offset + size);
+    if (next != block.freeByOffset.end() && next->first == offset + size) {
+        size += next->second;
+        eraseFree(block, next);
+    }
+    insertFree(block, offset, size);
+
+    // Empty blocks are given back, the first one stays for the next allocations
+    if (block.liveRanges == 0 && range.block != 0) {
+        for (auto it = vertexArrays.begin(); it != vertexArrays.end();) {
+            bool uses = range.pool == GpuPool::Vertex ? it->first.vertexBlock == range.block : it->first.indexBlock == range.block;
+            if (uses) {
+                glDeleteVertexArrays(1, &it->second);
+                it = vertexArrays.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        glDeleteBuffers(1, &block.buffer);
+        block = Block();
+    }
+}
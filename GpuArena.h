@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <vector>
+#include <glad.h>
+
+// Vertex data of every format shares one pool, element data the other
+enum class GpuPool {
+    Vertex,
+    Index
+};
+
+// Part of an arena buffer owned by one mesh
+struct GpuRange {
+    GpuPool pool = GpuPool::Vertex;
+    int block = -1;
+    size_t offset = 0;      // Bytes from the start of the block's buffer
+    size_t size = 0;
+
+    bool valid() const { return block >= 0; }
+};
+
+struct GpuArenaStats {
+    size_t blocks = 0;
+    size_t reservedBytes = 0;       // Buffer storage resident on the GPU
+    size_t usedBytes = 0;           // Handed out in live ranges
+    size_t retiredBytes = 0;        // Freed, but the GPU may still read them
+    size_t freeBytes = 0;
+    size_t largestFree = 0;
+    size_t freeRanges = 0;
+    size_t liveRanges = 0;
+    unsigned long long allocations = 0;     // Since startup
+    unsigned long long blockAllocations = 0;
+
+    // Share of the free space outside the largest free range, 0 when free space is in one piece
+    float fragmentation() const { return freeBytes ? 1.0f - (float)largestFree / (float)freeBytes : 0.0f; }
+};
+
+/*
+ * Vertex and index storage shared by all meshes. Each pool is a list of
+ * large buffers, ranges are suballocated best-fit from a free list that
+ * merges neighbouring ranges when they are freed.
+ *
+ * Freed ranges are retired until a fence shows the GPU finished the frame
+ * that freed them, so a new upload never overwrites data that is still being
+ * drawn and never waits on the driver. Blocks that become empty are given
+ * back, except for the first one of each pool.
+ *
+ * Meshes of one vertex format whose ranges lie in the same vertex and index
+ * blocks share a vertex array, they are drawn with base vertex offsets.
+ *
+ * The arena is a static, so it outlives the GL context. shutdown() has to
+ * release its objects while the context is still current.
+ *
+ * */
+
+class GpuArena {
+public:
+    static GpuArena& instance();
+
+    GpuArena(const GpuArena&) = delete;
+    GpuArena& operator=(const GpuArena&) = delete;
+
+    // Invalid range for size 0. Offsets are multiples of alignment.
+    GpuRange allocate(GpuPool pool, size_t size, size_t alignment);
+    // The range is reused once the GPU is done with the current frame
+    void free(GpuRange &range);
+    unsigned int buffer(const GpuRange &range) const;
+
+    // Shared vertex array for a format key and the blocks of a vertex and an index range.
+    // created is set when it is new and its attributes still have to be set up.
+    unsigned int vertexArray(int formatKey, const GpuRange &vertices, const GpuRange &indices, bool &created);
+
+    // Fences the frame and recycles ranges retired in frames the GPU has finished
+    void endFrame();
+    // Deletes every buffer, vertex array and fence, once all meshes are gone
+    void shutdown();
+
+    GpuArenaStats stats(GpuPool pool) const;
+    size_t vertexArrayCount() const { return vertexArrays.size(); }
+
+    // New blocks are at least this large, bigger ranges get a block of their own
+    static const size_t BLOCK_BYTES = 32 << 20;
+
+private:
+    GpuArena() = default;
+
+    struct Block {
+        unsigned int buffer = 0;        // 0 if the slot is unused
+        size_t size = 0;
+        size_t used = 0;
+        size_t liveRanges = 0;
+        std::map<size_t, size_t> freeByOffset;          // Offset -> size
+        std::multimap<size_t, size_t> freeBySize;       // Size -> offset
+    };
+
+    struct Pool {
+        std::vector<Block> blocks;
+        unsigned long long allocations = 0;
+        unsigned long long blockAllocations = 0;
+        size_t retiredBytes = 0;
+    };
+
+    struct RetiredFrame {
+        GLsync fence = nullptr;
+        std::vector<GpuRange> ranges;
+    };
+
+    struct VertexArrayKey {
+        int formatKey;
+        int vertexBlock;
+        int indexBlock;
+        bool operator<(const VertexArrayKey &other) const;
+    };
+
+    Pool pools[2];
+    std::vector<GpuRange> retiring;         // Freed during the current frame
+    std::deque<RetiredFrame> retired;       // Oldest first, waiting on their fences
+    std::map<VertexArrayKey, unsigned int> vertexArrays;
+
+    Pool& pool(GpuPool pool) { return pools[(int)pool]; }
+    const Pool& pool(GpuPool pool) const { return pools[(int)pool]; }
+    int addBlock(GpuPool pool, size_t size);
+    bool allocateIn(Block &block, size_t size, size_t alignment, size_t &offset);
+    void insertFree(Block &block, size_t offset, size_t size);
+    void eraseFree(Block &block, std::map<size_t, size_t>::iterator range);
+    void recycle(const GpuRange &range);
+};
@@ -0,0 +1,59 @@
+#include "GpuTimer.h"
+
+#include <glad/glad.h>
+
+GpuTimer::GpuTimer() : pending{}, current(0), active(false), average(0.0f), samples(0) {
+    glGenQueries(QUERY_COUNT, queries);
+}
+
+GpuTimer::~GpuTimer() {
+    glDeleteQueries(QUERY_COUNT, queries);
+}
+
+void GpuTimer::begin() {
+    collect();
+
+    // Every query is still in flight, skip this measurement rather than wait
+    if (pending[current])
+        return;
+
+    glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    active = true;
+}
+
+void GpuTimer::end() {
+    if (!active)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[current] = true;
+    current = (current + 1) % QUERY_COUNT;
+    active = false;
+}
+
+void GpuTimer::reset() {
+    average = 0.0f;
+    samples = 0;
+}
+
+void GpuTimer::collect() {
+    for (int i = 0; i < QUERY_COUNT; i++) {
+        if (!pending[i])
+            continue;
+
+        int available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+        pending[i] = false;
+
+        // Plain mean for the first samples, then an exponential moving average
+        float ms = (float)nanoseconds / 1.0e6f;
+        samples++;
+        float weight = samples < 32 ? 1.0f / (float)samples : 1.0f / 32.0f;
+        average += (ms - average) * weight;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * GPU time of a sequence of commands measured with GL_TIME_ELAPSED queries.
+ * Queries are kept in a small ring and only read once their result is
+ * available, so timing never stalls the pipeline.
+ *
+ * */
+
+class GpuTimer {
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin();
+    void end();
+
+    // Moving average of the finished measurements in milliseconds
+    float milliseconds() const { return average; }
+    void reset();
+
+private:
+    static const int QUERY_COUNT = 4;
+    unsigned int queries[QUERY_COUNT];
+    bool pending[QUERY_COUNT];
+    int current;
+    bool active;
+    float average;
+    int samples;
+
+    void collect();
+};
@@ -0,0 +1,240 @@
+#include "Json.h"
+
+#include <charconv>
+#include <cstring>
+
+namespace {
+    const JsonValue NULL_VALUE;
+
+    // Nesting limit, deeper documents are rejected instead of overflowing the stack
+    const int MAX_DEPTH = 256;
+
+    struct Parser {
+        const char *begin;
+        const char *p;
+        const char *end;
+        std::string error;
+
+        bool fail(const char *message) {
+            if (error.empty())
+                error = std::string(message) + " at byte " + std::to_string(p - begin);
+            return false;
+        }
+
+        void skipSpaces() {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                p++;
+        }
+
+        bool literal(const char *word) {
+            size_t length = std::strlen(word);
+            if ((size_t)(end - p) < length || std::memcmp(p, word, length) != 0)
+                return fail("invalid literal");
+            p += length;
+            return true;
+        }
+
+        static void appendUtf8(std::string &out, unsigned int code) {
+            if (code < 0x80) {
+                out += (char)code;
+            } else if (code < 0x800) {
+                out += (char)(0xC0 | (code >> 6));
+                out += (char)(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                out += (char)(0xE0 | (code >> 12));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            } else {
+                out += (char)(0xF0 | (code >> 18));
+                out += (char)(0x80 | ((code >> 12) & 0x3F));
+                out += (char)(0x80 | ((code >> 6) & 0x3F));
+                out += (char)(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool hex4(unsigned int &code) {
+            if (end - p < 4)
+                return fail("truncated escape");
+            auto [next, result] = std::from_chars(p, p + 4, code, 16);
+            if (result != std::errc() || next != p + 4)
+                return fail("invalid escape");
+            p += 4;
+            return true;
+        }
+
+        bool parseString(std::string &out) {
+            p++;    // Opening quote
+            while (true) {
+                // Copy the run up to the next quote or escape at once
+                const char *run = p;
+                while (p < end && *p != '"' && *p != '\\')
+                    p++;
+                out.append(run, p);
+                if (p >= end)
+                    return fail("unterminated string");
+                if (*p++ == '"')
+                    return true;
+
+                if (p >= end)
+                    return fail("unterminated string");
+                char escape = *p++;
+                switch (escape) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        unsigned int code;
+                        if (!hex4(code))
+                            return false;
+                        // Surrogate pairs encode code points above the basic plane
+                        if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                            p += 2;
+                            unsigned int low;
+                            if (!hex4(low))
+                                return false;
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUtf8(out, code);
+                        break;
+                    }
+                    default:
+                        return fail("invalid escape");
+                }
+            }
+        }
+
+        bool parseNumber(double &out) {
+            // from_chars takes no leading '+', which JSON does not allow either
+            auto [next, result] = std::from_chars(p, end, out);
+            if (result != std::errc())
+                return fail("invalid number");
+            p = next;
+            return true;
+        }
+
+        bool parseValue(JsonValue &out, int depth) {
+            if (depth > MAX_DEPTH)
+                return fail("nesting too deep");
+            skipSpaces();
+            if (p >= end)
+                return fail("unexpected end");
+
+            switch (*p) {
+                case '{': {
+                    out.type = JsonValue::Type::Object;
+                    p++;
+                    skipSpaces();
+                    if (p < end && *p == '}') {
+                        p++;
+                        return true;
+                    }
+                    while (true) {
+                        skipSpaces();
+                        if (p >= end || *p != '"')
+                            return fail("expected member name");
+                        out.object.emplace_back();
+                        if (!parseString(out.object.back().first))
+                            return false;
+                        skipSpaces();
+                        if (p >= end || *p++ != ':')
+                            return fail("expected ':'");
+                        if (!parseValue(out.object.back().second, depth + 1))
+                            return false;
+                        skipSpaces();
+                        if (p < end && *p == ',') {
+                            p++;
+                            continue;
+                        }
+                        if (p < end && *p == '}') {
+                            p++;
+                            return true;
+                        }
+                        return fail("expected ',' or '}'");
+                    }
+                }
+                case '[': {
+                    out.type = JsonValue::Type::Array;
+                    p++;
+                    skipSpaces();
+                    if (p < end && *p == ']') {
+                        p++;
+                        return true;
+                    }
+                    while (true) {
+                        out.array.emplace_back();
+                        if (!parseValue(out.array.back(), depth + 1))
+                            return false;
+                        skipSpaces();
+                        if (p < end && *p == ',') {
+                            p++;
+                            continue;
+                        }
+                        if (p < end && *p == ']') {
+                            p++;
+                            return true;
+                        }
+                        return fail("expected ',' or ']'");
+                    }
+                }
+                case '"':
+                    out.type = JsonValue::Type::String;
+                    return parseString(out.string);
+                case 't':
+                    out.type = JsonValue::Type::Bool;
+                    out.boolean = true;
+                    return literal("true");
+                case 'f':
+                    out.type = JsonValue::Type::Bool;
+                    out.boolean = false;
+                    return literal("false");
+                case 'n':
+                    out.type = JsonValue::Type::Null;
+                    return literal("null");
+                default:
+                    out.type = JsonValue::Type::Number;
+                    return parseNumber(out.number);
+            }
+        }
+    };
+}
+
+bool JsonValue::parse(const char *begin, const char *end, JsonValue &out, std::string &error) {
+    Parser parser{begin, begin, end, {}};
+    out = JsonValue();
+    if (!parser.parseValue(out, 0)) {
+        error = parser.error;
+        return false;
+    }
+    parser.skipSpaces();
+    if (parser.p != end) {
+        parser.fail("trailing characters");
+        error = parser.error;
+        return false;
+    }
+    return true;
+}
+
+const JsonValue* JsonValue::find(const std::string &key) const {
+    for (const auto &member : object)
+        if (member.first == key)
+            return &member.second;
+    return nullptr;
+}
+
+const JsonValue& JsonValue::operator[](const std::string &key) const {
+    const JsonValue *value = find(key);
+    return value ? *value : NULL_VALUE;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    return index < array.size() ? array[index] : NULL_VALUE;
+}
+
+size_t JsonValue::size() const {
+    return isArray() ? array.size() : isObject() ? object.size() : 0;
+}
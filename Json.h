@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Minimal JSON document, enough for glTF headers. Objects keep their members
+ * in file order and are searched linearly, they are small in every format we
+ * read. Lookups of missing members or out of range elements return a shared
+ * null value, so chained lookups never need checks in between.
+ *
+ * */
+
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    // False with a message holding the byte offset if text is not a single valid JSON value
+    static bool parse(const char *begin, const char *end, JsonValue &out, std::string &error);
+
+    bool isNull() const { return type == Type::Null; }
+    bool isNumber() const { return type == Type::Number; }
+    bool isString() const { return type == Type::String; }
+    bool isArray() const { return type == Type::Array; }
+    bool isObject() const { return type == Type::Object; }
+
+    const JsonValue* find(const std::string &key) const;
+    const JsonValue& operator[](const std::string &key) const;
+    const JsonValue& operator[](size_t index) const;
+    // Elements of an array or members of an object, 0 otherwise
+    size_t size() const;
+
+    double asNumber(double fallback = 0.0) const { return isNumber() ? number : fallback; }
+    int asInt(int fallback = -1) const { return isNumber() ? (int)number : fallback; }
+    bool asBool(bool fallback = false) const { return type == Type::Bool ? boolean : fallback; }
+    const std::string& asString() const { return string; }
+};
@@ -0,0 +1,101 @@
+#include "MaterialSweep.h"
+
+#include <algorithm>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+    // Share of a cell covered by its mesh, the rest is the gap to the neighbours
+    const float CELL_FILL = 0.85f;
+
+    glm::vec4 sweepValue(const SweepAxis &axis, int cell, int cells) {
+        float t = cells > 1 ? (float)cell / (float)(cells - 1) : 0.5f;
+        return axis.min + (axis.max - axis.min) * t;
+    }
+}
+
+MaterialSweep::MaterialSweep() {
+    glGenBuffers(1, &buffer);
+}
+
+MaterialSweep::~MaterialSweep() {
+    glDeleteBuffers(1, &buffer);
+}
+
+void MaterialSweep::update(int columns, int rows, float radius, const glm::mat4 &base,
+                           const SweepAxis &x, const SweepAxis &y) {
+    columns = std::max(columns, 1);
+    rows = std::max(rows, 1);
+    const float cell = 2.0f * radius / (float)std::max(columns, rows);
+    const float scale = cell / (2.0f * radius) * CELL_FILL;
+
+    std::vector<SweepInstance> next(columns * rows);
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            // Row 0 at the top, the grid is centered on the origin
+            glm::vec3 center(cell * (column + 0.5f - columns * 0.5f), cell * (rows * 0.5f - row - 0.5f), 0.0f);
+            SweepInstance &instance = next[row * columns + column];
+            instance.model = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(scale)) * base;
+            instance.x = sweepValue(x, column, columns);
+            instance.y = sweepValue(y, row, rows);
+        }
+    }
+
+    if (next.size() == instances.size() && std::memcmp(next.data(), instances.data(), next.size() * sizeof(SweepInstance)) == 0)
+        return;
+
+    instances = std::move(next);
+    size_t bytes = instances.size() * sizeof(SweepInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (bytes > capacity) {
+        glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), GL_DYNAMIC_DRAW);
+        capacity = bytes;
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MaterialSweep::draw(const Mesh &mesh, Shader &shader, GLenum mode) const {
+    InstanceBuffer instanceBuffer;
+    instanceBuffer.buffer = buffer;
+    instanceBuffer.vec4Count = sizeof(SweepInstance) / sizeof(glm::vec4);
+    instanceBuffer.count = count();
+    mesh.drawInstanced(shader, mode, instanceBuffer);
+}
+
+ShaderDefines MaterialSweep::defines(const SweepAxis &x, const SweepAxis &y) {
+    ShaderDefines defines = {{"MATERIAL_SWEEP", ""}};
+    if (!x.field.empty()) {
+        defines["SWEEP_X_FIELD"] = x.field;
+        defines["SWEEP_X_SWIZZLE"] = x.color ? "xyz" : "x";
+    }
+    if (!y.field.empty()) {
+        defines["SWEEP_Y_FIELD"] = y.field;
+        defines["SWEEP_Y_SWIZZLE"] = y.color ? "xyz" : "x";
+    }
+    return defines;
+}
+
+bool MaterialSweep::sweepable(const ParameterField &field) {
+    return field.annotated && field.name.find('[') == std::string::npos
+           && (field.type == GL_FLOAT || (field.type == GL_FLOAT_VEC3 && field.color));
+}
+
+SweepAxis MaterialSweep::axis(const ParameterField &field, const void *blockData) {
+    SweepAxis axis;
+    // Reflected names carry the block member, e.g. "material.shininess"
+    size_t dot = field.name.find_last_of('.');
+    axis.field = field.name.substr(dot == std::string::npos ? 0 : dot + 1);
+
+    const float *value = reinterpret_cast<const float*>(static_cast<const unsigned char*>(blockData) + field.offset);
+    if (field.type == GL_FLOAT_VEC3) {
+        axis.color = true;
+        axis.min = glm::vec4(0.0f);
+        axis.max = glm::vec4(value[0], value[1], value[2], 0.0f);
+    } else {
+        axis.min = glm::vec4(field.min);
+        axis.max = glm::vec4(field.max);
+    }
+    return axis;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "Shader.h"
+
+// One grid cell as read by shaders/surfaceV.glsl with MATERIAL_SWEEP: the transform, then the
+// values of the members swept along x and y
+struct SweepInstance {
+    glm::mat4 model;
+    glm::vec4 x;
+    glm::vec4 y;
+};
+
+// Material member swept along one grid axis, from min in the first cell to max in the last
+struct SweepAxis {
+    std::string field;      // Member of MaterialData, e.g. "shininess". Empty keeps the block's value.
+    bool color = false;     // vec3 member, otherwise float
+    glm::vec4 min = glm::vec4(0.0f);
+    glm::vec4 max = glm::vec4(1.0f);
+};
+
+/*
+ * Grid of copies of one mesh drawn with a single instanced call. Columns
+ * sweep one member of the shading model's material and rows another, so a
+ * model is compared across its parameter range in one frame. Members that are
+ * not swept still come from the Material block.
+ *
+ * The instances are recomputed on every update, the buffer is only written
+ * when they changed.
+ *
+ * */
+
+class MaterialSweep {
+public:
+    MaterialSweep();
+    ~MaterialSweep();
+
+    MaterialSweep(const MaterialSweep&) = delete;
+    MaterialSweep& operator=(const MaterialSweep&) = delete;
+
+    // Lays out columns x rows cells in the xy plane, together as large as one mesh of
+    // the given radius after base is applied
+    void update(int columns, int rows, float radius, const glm::mat4 &base, const SweepAxis &x, const SweepAxis &y);
+    void draw(const Mesh &mesh, Shader &shader, GLenum mode) const;
+    int count() const { return (int)instances.size(); }
+
+    // MATERIAL_SWEEP and the members read from the instances
+    static ShaderDefines defines(const SweepAxis &x, const SweepAxis &y);
+    // Whether a reflected block member can be swept: floats and colors outside arrays
+    static bool sweepable(const ParameterField &field);
+    // Floats run over their annotated range, colors from black to their current value in blockData
+    static SweepAxis axis(const ParameterField &field, const void *blockData);
+
+private:
+    unsigned int buffer = 0;
+    size_t capacity = 0;
+    std::vector<SweepInstance> instances;
+};
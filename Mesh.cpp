@@ -1,58 +1,680 @@
 #include "Mesh.h"
+#include "Parallel.h"
+#include "MeshTangents.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include <utility>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 #include <iostream>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices)
-    : vertices(std::move(vertices)), indices(std::move(indices)) {
+int Mesh::allocations = 0;
+size_t Mesh::gpuBytes = 0;
+
+namespace {
+    // Offsets of index ranges, enough for every index type
+    const size_t INDEX_ALIGNMENT = 4;
+
+    // Replaces range with a new arena range of size bytes. The old range is retired instead of
+    // rewritten, so the following writes never wait on draws still using the old contents.
+    void reserveRange(GpuPool pool, GpuRange &range, size_t size, size_t alignment) {
+        GpuArena &arena = GpuArena::instance();
+        Mesh::gpuBytes -= range.size;
+        arena.free(range);
+        range = arena.allocate(pool, size, alignment);
+        if (range.valid()) {
+            Mesh::gpuBytes += range.size;
+            Mesh::allocations++;
+        }
+    }
+
+    // Writes the next slice of data into range, returns the bytes written. The copy target
+    // leaves the vertex array's element buffer binding alone.
+    size_t writeSlice(const GpuRange &range, const void *data, size_t size, size_t &written, size_t budget) {
+        size_t slice = std::min(size - written, budget);
+        if (slice > 0) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, GpuArena::instance().buffer(range));
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset + written, slice, static_cast<const unsigned char*>(data) + written);
+            written += slice;
+        }
+        return slice;
+    }
+
+    // Element buffer contents in the narrower type T, restart markers become T's largest value
+    template<typename T>
+    std::vector<unsigned char> narrowIndices(const std::vector<unsigned int> &indices) {
+        std::vector<unsigned char> bytes(indices.size() * sizeof(T));
+        T *narrow = reinterpret_cast<T*>(bytes.data());
+        for (size_t i = 0; i < indices.size(); i++)
+            narrow[i] = indices[i] == MeshData::RESTART_INDEX ? std::numeric_limits<T>::max() : (T)indices[i];
+        return bytes;
+    }
+
+    const void* vertexSource(const MeshUpload &upload) {
+        return upload.format == VertexFormat::Float ? (const void*)upload.data.vertices.data() : (const void*)upload.packed.data();
+    }
+
+    size_t vertexSourceSize(const MeshUpload &upload) {
+        return upload.format == VertexFormat::Float ? upload.data.vertices.size() * sizeof(Vertex)
+                                                    : upload.packed.size() * sizeof(PackedVertex);
+    }
+
+    const void* indexSource(const MeshUpload &upload) {
+        return upload.indexType == GL_UNSIGNED_INT ? (const void*)upload.data.indices.data() : (const void*)upload.narrowIndices.data();
+    }
+
+    size_t indexSourceSize(const MeshUpload &upload) {
+        return upload.indexType == GL_UNSIGNED_INT ? upload.data.indices.size() * sizeof(unsigned int)
+                                                   : upload.narrowIndices.size();
+    }
+
+    // Vertex on a sphere around the origin with a spherical uv mapping, uvs wrap at the seam
+    Vertex sphereVertex(glm::vec3 direction, float radius) {
+        auto pi = glm::pi<float>();
+        glm::vec3 normal = glm::normalize(direction);
+
+        Vertex vertex;
+        vertex.position = normal * radius;
+        vertex.normal = normal;
+        vertex.texCoords = glm::vec2(std::atan2(normal.z, normal.x) / (2*pi) + 0.5f,
+                                     std::asin(glm::clamp(normal.y, -1.0f, 1.0f)) / pi + 0.5f);
+        return vertex;
+    }
+
+    // Gives the triangles of a mesh built from sphereVertex their own copies of the vertices where
+    // its mapping jumps: corners on the low side of the u = 0/1 seam get u + 1, and corners on a
+    // pole, where u is arbitrary, take the mean u of the other two. Uvs and tangents then
+    // interpolate across every triangle without wrapping.
+    void splitSphereSeam(MeshData &data) {
+        std::vector<Vertex> &vertices = data.vertices;
+        std::unordered_map<unsigned int, unsigned int> wrapped;     // Vertex -> its copy at u + 1
+        auto onPole = [&](unsigned int index) {
+            const glm::vec3 &normal = vertices[index].normal;
+            return std::abs(normal.x) < 1e-6f && std::abs(normal.z) < 1e-6f;
+        };
+
+        for (size_t triangle = 0; triangle + 2 < data.indices.size(); triangle += 3) {
+            unsigned int *corners = &data.indices[triangle];
+            float low = 1.0f, high = 0.0f;
+            for (int corner = 0; corner < 3; corner++)
+                if (!onPole(corners[corner])) {
+                    low = std::min(low, vertices[corners[corner]].texCoords.x);
+                    high = std::max(high, vertices[corners[corner]].texCoords.x);
+                }
+
+            float uSum = 0.0f;
+            int uCount = 0;
+            for (int corner = 0; corner < 3; corner++) {
+                unsigned int &index = corners[corner];
+                if (onPole(index))
+                    continue;
+                if (high - low > 0.5f && vertices[index].texCoords.x < 0.5f) {
+                    auto [found, inserted] = wrapped.emplace(index, (unsigned int)vertices.size());
+                    if (inserted) {
+                        Vertex copy = vertices[index];
+                        copy.texCoords.x += 1.0f;
+                        vertices.push_back(copy);
+                    }
+                    index = found->second;
+                }
+                uSum += vertices[index].texCoords.x;
+                uCount++;
+            }
+
+            for (int corner = 0; corner < 3; corner++)
+                if (uCount && onPole(corners[corner])) {
+                    Vertex copy = vertices[corners[corner]];
+                    copy.texCoords.x = uSum / uCount;
+                    corners[corner] = (unsigned int)vertices.size();
+                    vertices.push_back(copy);
+                }
+        }
+    }
+
+    float signNotZero(float value) {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    glm::vec3 octahedralDecode(glm::vec2 encoded) {
+        glm::vec3 normal(encoded.x, encoded.y, 1.0f - glm::abs(encoded.x) - glm::abs(encoded.y));
+        if (normal.z < 0.0f)
+            normal = glm::vec3((1.0f - glm::abs(normal.y)) * signNotZero(normal.x),
+                               (1.0f - glm::abs(normal.x)) * signNotZero(normal.y), normal.z);
+        return glm::normalize(normal);
+    }
+
+    // Orthonormal basis around a unit normal without a branch on its direction (Duff et al. 2017).
+    // shaders/include/vertexInput.glsl builds the same one to decode packed tangents.
+    void tangentBasis(glm::vec3 normal, glm::vec3 &b1, glm::vec3 &b2) {
+        float side = signNotZero(normal.z);
+        float a = -1.0f / (side + normal.z);
+        float b = normal.x * normal.y * a;
+        b1 = glm::vec3(1.0f + side * normal.x * normal.x * a, side * b, -side * normal.x);
+        b2 = glm::vec3(b, side + normal.y * normal.y * a, -normal.y);
+    }
+
+    // Angle of the tangent in the basis of the normal in 15 bits, the handedness in the top bit
+    uint16_t encodeTangent(glm::vec3 normal, glm::vec4 tangent) {
+        glm::vec3 b1, b2;
+        tangentBasis(normal, b1, b2);
+        float turns = std::atan2(glm::dot(glm::vec3(tangent), b2), glm::dot(glm::vec3(tangent), b1)) / (2.0f * glm::pi<float>());
+        uint16_t angle = (uint16_t)((int)std::lround((turns < 0.0f ? turns + 1.0f : turns) * 32768.0f) & 0x7FFF);
+        return (uint16_t)(angle | (tangent.w < 0.0f ? 0x8000 : 0));
+    }
+
+    // Inverse of encodeTangent, as vertexTangent() in shaders/include/vertexInput.glsl decodes it
+    glm::vec4 decodeTangent(glm::vec3 normal, uint16_t bits) {
+        glm::vec3 b1, b2;
+        tangentBasis(normal, b1, b2);
+        float angle = (bits & 0x7FFF) * (2.0f * glm::pi<float>() / 32768.0f);
+        return glm::vec4(std::cos(angle) * b1 + std::sin(angle) * b2, bits & 0x8000 ? -1.0f : 1.0f);
+    }
+
+    // The packed tangent has to come back as the tangent projected onto the plane of the decoded normal
+    bool tangentRoundTrips(glm::vec3 normal, glm::vec4 tangent, uint16_t bits) {
+        glm::vec3 projected = glm::vec3(tangent) - normal * glm::dot(normal, glm::vec3(tangent));
+        float length = glm::length(projected);
+        if (length < 1e-3f)
+            return true;
+        glm::vec4 decoded = decodeTangent(normal, bits);
+        return glm::dot(glm::vec3(decoded), projected / length) > 0.9999f && (decoded.w < 0.0f) == (tangent.w < 0.0f);
+    }
+
+    // Maps a direction onto the octahedron and unfolds it to [-1, 1]^2
+    glm::vec2 octahedralEncode(glm::vec3 normal) {
+        float sum = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+        if (sum == 0.0f)
+            return glm::vec2(0.0f, 0.0f);
+
+        glm::vec2 encoded(normal.x / sum, normal.y / sum);
+        if (normal.z < 0.0f)
+            encoded = glm::vec2((1.0f - glm::abs(encoded.y)) * signNotZero(encoded.x),
+                                (1.0f - glm::abs(encoded.x)) * signNotZero(encoded.y));
+        return encoded;
+    }
+}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, VertexFormat format)
+    : vertices(std::move(vertices)), indices(std::move(indices)), format(format) {
     setupMesh();
 }
 
-void Mesh::draw(Shader &shader, GLenum mode) const {
-    for (int i = 0; i < textures.size(); i++) {
-        glActiveTexture(GL_TEXTURE0+i);
-        std::string number;
-        std::string name = textures[i].type;
+Mesh::Mesh(MeshData data, VertexFormat format)
+    : vertices(std::move(data.vertices)), indices(std::move(data.indices)), format(format), primitive(data.primitive),
+      tangents(data.tangents) {
+    setupMesh();
+}
 
-        glUniform1i(glGetUniformLocation(shader.ID, name.c_str()), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+Mesh::~Mesh() {
+    release();
+}
+
+Mesh::Mesh(Mesh &&other) noexcept
+    : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+      VAO(other.VAO), vertexRange(other.vertexRange), indexRange(other.indexRange),
+      ownsVertexArray(other.ownsVertexArray), format(other.format),
+      primitive(other.primitive), indexType(other.indexType), indexCount(other.indexCount),
+      positionScale(other.positionScale), positionOffset(other.positionOffset), texCoordTransform(other.texCoordTransform),
+      tangents(other.tangents), customLayout(other.customLayout), positionAttribute(other.positionAttribute),
+      texCoordAttribute(other.texCoordAttribute), normalAttribute(other.normalAttribute),
+      tangentAttribute(other.tangentAttribute), staged(std::move(other.staged)) {
+    other.VAO = 0;
+    other.vertexRange = GpuRange{GpuPool::Vertex};
+    other.indexRange = GpuRange{GpuPool::Index};
+    other.ownsVertexArray = false;
+    other.textures.clear();
+}
+
+Mesh& Mesh::operator=(Mesh &&other) noexcept {
+    if (this != &other) {
+        release();
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        VAO = other.VAO;
+        vertexRange = other.vertexRange;
+        indexRange = other.indexRange;
+        ownsVertexArray = other.ownsVertexArray;
+        format = other.format;
+        primitive = other.primitive;
+        indexType = other.indexType;
+        indexCount = other.indexCount;
+        positionScale = other.positionScale;
+        positionOffset = other.positionOffset;
+        texCoordTransform = other.texCoordTransform;
+        tangents = other.tangents;
+        customLayout = other.customLayout;
+        positionAttribute = other.positionAttribute;
+        texCoordAttribute = other.texCoordAttribute;
+        normalAttribute = other.normalAttribute;
+        tangentAttribute = other.tangentAttribute;
+        staged = std::move(other.staged);
+
+        other.VAO = 0;
+        other.vertexRange = GpuRange{GpuPool::Vertex};
+        other.indexRange = GpuRange{GpuPool::Index};
+        other.ownsVertexArray = false;
+        other.textures.clear();
     }
+    return *this;
+}
 
-    glBindVertexArray(VAO);
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, 0);
+void Mesh::release() {
+    for (const Texture &texture : textures)
+        glDeleteTextures(1, &texture.id);
+    textures.clear();
+
+    if (ownsVertexArray)
+        glDeleteVertexArrays(1, &VAO);
+    VAO = 0;
+    ownsVertexArray = false;
+
+    gpuBytes -= vertexRange.size + indexRange.size;
+    GpuArena::instance().free(vertexRange);
+    GpuArena::instance().free(indexRange);
+    staged.reset();
+}
+
+void Mesh::upload(MeshData data) {
+    upload(std::move(data), format);
+}
+
+void Mesh::upload(MeshData data, VertexFormat newFormat) {
+    beginUpload(prepare(std::move(data), newFormat));
+    continueUpload(std::numeric_limits<size_t>::max());
+}
+
+void Mesh::upload(const EncodedMesh &encoded) {
+    vertices.clear();
+    indices.clear();
+    staged.reset();
+    format = encoded.format;
+    primitive = encoded.primitive;
+    indexType = encoded.indexType;
+    indexCount = encoded.indexCount;
+    positionScale = encoded.positionScale;
+    positionOffset = encoded.positionOffset;
+    texCoordTransform = encoded.texCoordTransform;
+    customLayout = encoded.customLayout && encoded.format == VertexFormat::Float;
+    tangents = customLayout ? encoded.tangent.enabled : encoded.tangents;
+    positionAttribute = encoded.position;
+    texCoordAttribute = encoded.texCoords;
+    normalAttribute = encoded.normal;
+    tangentAttribute = encoded.tangent;
+
+    // Custom layouts only need their attribute offsets aligned, which glTF already guarantees
+    size_t vertexWritten = 0, indexWritten = 0;
+    reserveRange(GpuPool::Vertex, vertexRange, encoded.vertexBytes, customLayout ? sizeof(float) : vertexSize(format));
+    writeSlice(vertexRange, encoded.vertexData, encoded.vertexBytes, vertexWritten, encoded.vertexBytes);
+    reserveRange(GpuPool::Index, indexRange, indexBytes(), INDEX_ALIGNMENT);
+    writeSlice(indexRange, encoded.indexData, indexBytes(), indexWritten, indexBytes());
+    setupVertexArray();
+}
+
+MeshUpload Mesh::prepare(MeshData data, VertexFormat format) {
+    MeshUpload upload;
+    upload.format = format;
+    // Packing reads the tangent flag from upload.data, so the data goes in first
+    upload.data = std::move(data);
+    if (format != VertexFormat::Float)
+        upload.packed = packVertices(upload.data.vertices, upload);
+
+    // The narrowest index type that addresses every vertex, its largest value stays free for restarts
+    const MeshData &staged = upload.data;
+    if (staged.vertices.size() <= 0xFF) {
+        upload.indexType = GL_UNSIGNED_BYTE;
+        upload.narrowIndices = narrowIndices<uint8_t>(staged.indices);
+    } else if (staged.vertices.size() <= 0xFFFF) {
+        upload.indexType = GL_UNSIGNED_SHORT;
+        upload.narrowIndices = narrowIndices<uint16_t>(staged.indices);
+    }
+    return upload;
+}
+
+void Mesh::beginUpload(MeshUpload upload) {
+    // A newer upload replaces one still in progress, its ranges are simply replaced again
+    staged = std::make_unique<MeshUpload>(std::move(upload));
+    staged->vertexWritten = staged->indexWritten = 0;
+
+    reserveRange(GpuPool::Vertex, vertexRange, vertexSourceSize(*staged), vertexSize(staged->format));
+    reserveRange(GpuPool::Index, indexRange, indexSourceSize(*staged), INDEX_ALIGNMENT);
+}
+
+bool Mesh::continueUpload(size_t budget) {
+    if (!staged)
+        return true;
+
+    const size_t vertexBytes = vertexSourceSize(*staged), indexBytes = indexSourceSize(*staged);
+    budget -= writeSlice(vertexRange, vertexSource(*staged), vertexBytes, staged->vertexWritten, budget);
+    writeSlice(indexRange, indexSource(*staged), indexBytes, staged->indexWritten, budget);
+    if (staged->vertexWritten < vertexBytes || staged->indexWritten < indexBytes)
+        return false;
+
+    vertices = std::move(staged->data.vertices);
+    indices = std::move(staged->data.indices);
+    primitive = staged->data.primitive;
+    format = staged->format;
+    indexType = staged->indexType;
+    indexCount = indices.size();
+    positionScale = staged->positionScale;
+    positionOffset = staged->positionOffset;
+    texCoordTransform = staged->texCoordTransform;
+    tangents = staged->data.tangents;
+    customLayout = false;
+    staged.reset();
+
+    setupVertexArray();
+    return true;
+}
+
+size_t Mesh::triangleCount() const {
+    if (primitive != GL_TRIANGLE_STRIP)
+        return indexCount / 3;
+
+    // Every strip of n indices between restarts holds n - 2 triangles
+    size_t triangles = 0, run = 0;
+    for (unsigned int index : indices) {
+        if (index == MeshData::RESTART_INDEX) {
+            triangles += run > 2 ? run - 2 : 0;
+            run = 0;
+        } else {
+            run++;
+        }
+    }
+    return triangles + (run > 2 ? run - 2 : 0);
+}
+
+size_t Mesh::indexSize() const {
+    return indexType == GL_UNSIGNED_BYTE ? 1 : indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+size_t Mesh::vertexSize(VertexFormat format) {
+    return format == VertexFormat::Float ? sizeof(Vertex) : sizeof(PackedVertex);
+}
+
+// Encodes vertices into the compact layout and sets the matching decode parameters
+std::vector<PackedVertex> Mesh::packVertices(const std::vector<Vertex> &vertices, MeshUpload &upload) {
+    glm::vec3 minPosition(0.0f), maxPosition(0.0f);
+    glm::vec2 minTexCoord(0.0f), maxTexCoord(0.0f);
+    if (!vertices.empty()) {
+        minPosition = maxPosition = vertices[0].position;
+        minTexCoord = maxTexCoord = vertices[0].texCoords;
+    }
+    for (const Vertex &vertex : vertices) {
+        minPosition = glm::min(minPosition, vertex.position);
+        maxPosition = glm::max(maxPosition, vertex.position);
+        minTexCoord = glm::min(minTexCoord, vertex.texCoords);
+        maxTexCoord = glm::max(maxTexCoord, vertex.texCoords);
+    }
+
+    // Flat extents keep a scale of one so the decode never divides by zero
+    auto extent = [](float size) { return size > 0.0f ? size : 1.0f; };
+
+    if (upload.format == VertexFormat::Snorm16) {
+        glm::vec3 halfSize = (maxPosition - minPosition) * 0.5f;
+        upload.positionScale = glm::vec3(extent(halfSize.x), extent(halfSize.y), extent(halfSize.z));
+        upload.positionOffset = (maxPosition + minPosition) * 0.5f;
+    } else {
+        upload.positionScale = glm::vec3(1.0f);
+        upload.positionOffset = glm::vec3(0.0f);
+    }
+    glm::vec2 texCoordSize = maxTexCoord - minTexCoord;
+    upload.texCoordTransform = glm::vec4(extent(texCoordSize.x), extent(texCoordSize.y), minTexCoord.x, minTexCoord.y);
+
+    std::vector<PackedVertex> packed(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vertex &vertex = vertices[i];
+        PackedVertex &out = packed[i];
+
+        for (int c = 0; c < 3; c++) {
+            if (upload.format == VertexFormat::Half)
+                out.position[c] = glm::packHalf1x16(vertex.position[c]);
+            else
+                out.position[c] = glm::packSnorm1x16((vertex.position[c] - upload.positionOffset[c]) / upload.positionScale[c]);
+        }
+        glm::vec2 normal = octahedralEncode(vertex.normal);
+        out.normal[0] = (int16_t)glm::packSnorm1x16(normal.x);
+        out.normal[1] = (int16_t)glm::packSnorm1x16(normal.y);
+
+        // Measured around the normal the shader decodes, not the exact one, so the basis matches
+        out.position[3] = 0;
+        if (upload.data.tangents) {
+            glm::vec3 decoded = octahedralDecode(glm::vec2(glm::unpackSnorm1x16((uint16_t)out.normal[0]),
+                                                           glm::unpackSnorm1x16((uint16_t)out.normal[1])));
+            out.position[3] = encodeTangent(decoded, vertex.tangent);
+            assert(tangentRoundTrips(decoded, vertex.tangent, out.position[3]));
+        }
+
+        out.texCoords[0] = glm::packUnorm1x16((vertex.texCoords.x - upload.texCoordTransform.z) / upload.texCoordTransform.x);
+        out.texCoords[1] = glm::packUnorm1x16((vertex.texCoords.y - upload.texCoordTransform.w) / upload.texCoordTransform.y);
+    }
+    return packed;
+}
+
+// Points the vertex array at the arena buffers, sharing it with every mesh of the same format
+// whose ranges lie in the same blocks. Custom layouts have their attribute offsets baked in and
+// cannot share one.
+void Mesh::setupVertexArray() {
+    GpuArena &arena = GpuArena::instance();
+    if (ownsVertexArray)
+        glDeleteVertexArrays(1, &VAO);
+    VAO = 0;
+    ownsVertexArray = false;
+    if (!vertexRange.valid() || !indexRange.valid())
+        return;
+
+    if (customLayout) {
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.buffer(indexRange));
+        ownsVertexArray = true;
+        setupAttributes(vertexRange.offset);
+    } else {
+        bool created = false;
+        VAO = arena.vertexArray((int)format, vertexRange, indexRange, created);
+        if (created)
+            setupAttributes(0);
+    }
     glBindVertexArray(0);
+}
 
-    glActiveTexture(GL_TEXTURE0);
+// Expects the vertex array to be bound, offsets of custom layouts start at baseOffset
+void Mesh::setupAttributes(size_t baseOffset) const {
+    glBindBuffer(GL_ARRAY_BUFFER, GpuArena::instance().buffer(vertexRange));
+    for (unsigned int location = 0; location < 4; location++)
+        glEnableVertexAttribArray(location);
+
+    if (customLayout) {
+        const VertexAttribute *attributes[4] = {&positionAttribute, &texCoordAttribute, &normalAttribute, &tangentAttribute};
+        const int components[4] = {3, 2, 3, 4};
+        for (unsigned int location = 0; location < 4; location++) {
+            const VertexAttribute &attribute = *attributes[location];
+            if (attribute.enabled)
+                glVertexAttribPointer(location, components[location], GL_FLOAT, GL_FALSE, attribute.stride, (void*)(baseOffset + attribute.offset));
+            else
+                glDisableVertexAttribArray(location);
+        }
+        return;
+    }
+
+    if (format == VertexFormat::Float) {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        // vertex texture coords
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+        // vertex tangents
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+        return;
+    }
+
+    GLenum positionType = format == VertexFormat::Half ? GL_HALF_FLOAT : GL_SHORT;
+    GLboolean positionNormalized = format == VertexFormat::Snorm16 ? GL_TRUE : GL_FALSE;
+    glVertexAttribPointer(0, 4, positionType, positionNormalized, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoords));
+    // The raw 16 bits of the position's w, decoded in the shader
+    glVertexAttribPointer(3, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(PackedVertex),
+                          (void*)(offsetof(PackedVertex, position) + 3 * sizeof(uint16_t)));
 }
 
-void Mesh::setupMesh() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+// Vertices of shared vertex arrays are addressed relative to the start of the mesh's range
+GLint Mesh::baseVertex() const {
+    return customLayout ? 0 : (GLint)(vertexRange.offset / vertexSize(format));
+}
+
+void Mesh::draw(Shader &shader, GLenum mode) const {
+    // The ranges hold part of the next geometry while an upload is in progress
+    if (staged || !VAO)
+        return;
 
+    GLenum drawMode = beginDraw(shader, mode);
     glBindVertexArray(VAO);
+    glDrawElementsBaseVertex(drawMode, (GLsizei)indexCount, indexType, (void*)indexRange.offset, baseVertex());
+    glBindVertexArray(0);
+    endDraw();
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+void Mesh::drawInstanced(Shader &shader, GLenum mode, const InstanceBuffer &instances) const {
+    if (staged || !VAO || instances.count <= 0)
+        return;
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    GLenum drawMode = beginDraw(shader, mode);
+    glBindVertexArray(VAO);
+    bindInstances(instances);
+    glDrawElementsInstancedBaseVertex(drawMode, (GLsizei)indexCount, indexType, (void*)indexRange.offset,
+                                      instances.count, baseVertex());
+    unbindInstances(instances);
+    glBindVertexArray(0);
+    endDraw();
+}
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // vertex normals
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    // vertex texture coords
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+// Needs GL 4.3, or 4.6 for a count buffer
+void Mesh::drawIndirect(Shader &shader, GLenum mode, const InstanceBuffer &instances, const IndirectCommands &commands) const {
+    if (staged || !VAO || commands.maxDraws <= 0)
+        return;
 
+    GLenum drawMode = beginDraw(shader, mode);
+    glBindVertexArray(VAO);
+    bindInstances(instances);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.buffer);
+    if (commands.countBuffer) {
+        glBindBuffer(GL_PARAMETER_BUFFER, commands.countBuffer);
+        glMultiDrawElementsIndirectCount(drawMode, indexType, (void*)commands.offset, (GLintptr)commands.countOffset,
+                                         commands.maxDraws, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    } else {
+        glMultiDrawElementsIndirect(drawMode, indexType, (void*)commands.offset, commands.maxDraws, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    unbindInstances(instances);
     glBindVertexArray(0);
+    endDraw();
+}
+
+DrawElementsIndirectCommand Mesh::indirectCommand() const {
+    DrawElementsIndirectCommand command;
+    command.count = (GLuint)indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = (GLuint)(indexRange.offset / indexSize());
+    command.baseVertex = baseVertex();
+    command.baseInstance = 0;
+    return command;
+}
+
+bool Mesh::sharesDrawState(const Mesh &other) const {
+    return VAO == other.VAO && primitive == other.primitive && indexType == other.indexType && format == other.format
+           && positionScale == other.positionScale && positionOffset == other.positionOffset
+           && texCoordTransform == other.texCoordTransform && tangents == other.tangents
+           && textures.empty() && other.textures.empty();
+}
+
+// Bound only for one draw, so the vertex array stays valid for non-instanced shaders
+void Mesh::bindInstances(const InstanceBuffer &instances) const {
+    const GLsizei stride = instances.vec4Count * (GLsizei)sizeof(glm::vec4);
+    glBindBuffer(GL_ARRAY_BUFFER, instances.buffer);
+    for (int i = 0; i < instances.vec4Count; i++) {
+        unsigned int location = INSTANCE_LOCATION + i;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+void Mesh::unbindInstances(const InstanceBuffer &instances) const {
+    for (int i = 0; i < instances.vec4Count; i++)
+        glDisableVertexAttribArray(INSTANCE_LOCATION + i);
+}
+
+// Sets the textures and decode parameters and returns the primitive to draw in the given display mode
+GLenum Mesh::beginDraw(Shader &shader, GLenum mode) const {
+    for (int i = 0; i < textures.size(); i++) {
+        glActiveTexture(GL_TEXTURE0+i);
+        std::string number;
+        std::string name = textures[i].type;
+
+        shader.setInt(name, i);
+        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    }
+
+    // Decode parameters for the vertex format, shaders without a vertex stage input skip them
+    static const UniformHandle positionScaleHandle = Shader::handle("positionScale");
+    static const UniformHandle positionOffsetHandle = Shader::handle("positionOffset");
+    static const UniformHandle texCoordTransformHandle = Shader::handle("texCoordTransform");
+    static const UniformHandle octahedralNormalsHandle = Shader::handle("octahedralNormals");
+    static const UniformHandle vertexTangentsHandle = Shader::handle("vertexTangents");
+    if (shader.active(positionScaleHandle)) {
+        shader.setVec3(positionScaleHandle, positionScale);
+        shader.setVec3(positionOffsetHandle, positionOffset);
+    }
+    if (shader.active(texCoordTransformHandle))
+        shader.setVec4(texCoordTransformHandle, texCoordTransform);
+    if (shader.active(octahedralNormalsHandle))
+        shader.setBool(octahedralNormalsHandle, format != VertexFormat::Float);
+    if (shader.active(vertexTangentsHandle))
+        shader.setBool(vertexTangentsHandle, tangents);
+
+    // Strips keep the display modes: filled strips, their edges as line strips, or points
+    GLenum drawMode = mode;
+    if (primitive == GL_TRIANGLE_STRIP) {
+        if (mode == GL_TRIANGLES)
+            drawMode = GL_TRIANGLE_STRIP;
+        else if (mode == GL_LINES)
+            drawMode = GL_LINE_STRIP;
+
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(indexType == GL_UNSIGNED_BYTE ? 0xFF : indexType == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+    }
+
+    // Constant values of missing attributes are context state, not part of the vertex array
+    if (customLayout) {
+        if (!texCoordAttribute.enabled)
+            glVertexAttrib2f(1, 0.0f, 0.0f);
+        if (!normalAttribute.enabled)
+            glVertexAttrib3f(2, 0.0f, 1.0f, 0.0f);
+        if (!tangentAttribute.enabled)
+            glVertexAttrib4f(3, 0.0f, 0.0f, 0.0f, 0.0f);
+    }
+    return drawMode;
+}
+
+void Mesh::endDraw() const {
+    if (primitive == GL_TRIANGLE_STRIP)
+        glDisable(GL_PRIMITIVE_RESTART);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::setupMesh() {
+    upload(MeshData{std::move(vertices), std::move(indices), primitive, tangents}, format);
 }
 
 void Mesh::loadTexture(const char *path, std::string type) {
@@ -94,54 +716,133 @@ void Mesh::loadTexture(const char *path, std::string type) {
     textures.push_back(texture);
 }
 
-Mesh generateSphere(float radius, unsigned int rings, unsigned int segments) {
+MeshData sphereData(float radius, unsigned int rings, unsigned int segments, bool strips) {
     rings++;
     segments++;
 
     float const R = 1.0f/(float)(rings - 1);
     float const S = 1.0f/(float)(segments - 1);
+    auto pi = glm::pi<float>();
 
-    std::vector<Vertex> vertices(rings * segments);
-    std::vector<unsigned int> indices((rings-1) * (segments-1) * 6);
+    // Every vertex is a product of one ring and one segment term, each is only computed once
+    std::vector<float> ringRadius(rings), ringHeight(rings);
+    for (unsigned int r = 0; r < rings; r++) {
+        ringRadius[r] = sin( pi * r * R );
+        ringHeight[r] = sin( -pi/2 + pi * r * R );
+    }
+    std::vector<float> segmentCos(segments), segmentSin(segments);
+    for (unsigned int s = 0; s < segments; s++) {
+        segmentCos[s] = cos(2*pi * s * S);
+        segmentSin[s] = sin(2*pi * s * S);
+    }
 
-    int index = 0;
+    // Rows are independent, each worker fills whole rings
+    std::vector<Vertex> vertices((size_t)rings * segments);
+    parallelFor(rings, 64, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+            Vertex *row = &vertices[r * segments];
+            for (unsigned int s = 0; s < segments; s++) {
+                glm::vec3 const point(segmentCos[s] * ringRadius[r], ringHeight[r], segmentSin[s] * ringRadius[r]);
+                // Built in registers and stored whole, so the row is written with wide stores
+                row[s] = Vertex{point * radius, point * radius, glm::vec2(r*S, s*R)};
+            }
+        }
+    });
+
+    std::vector<unsigned int> indices;
+    if (strips) {
+        // Alternating between the two rings keeps the winding of the triangle list.
+        // A band is its strip plus the restart index before it, except for the first one.
+        const size_t band = (size_t)segments*2 + 1;
+        indices.resize((rings-1) * band - 1);
+        parallelFor(rings - 1, 64, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; r++) {
+                unsigned int *i = &indices[r * band - (r > 0)];
+                if (r > 0)
+                    *i++ = MeshData::RESTART_INDEX;
+                for (unsigned int s = 0; s < segments; s++) {
+                    *i++ = (r+1) * segments + s;
+                    *i++ = r * segments + s;
+                }
+            }
+        });
+        return MeshData{std::move(vertices), std::move(indices), GL_TRIANGLE_STRIP};
+    }
 
-    for (int r = 0; r < rings; r++)
-        for (int s = 0; s < segments; s++) {
-            auto pi = glm::pi<float>();
+    const size_t band = (size_t)(segments-1) * 6;
+    indices.resize((rings-1) * band);
+    parallelFor(rings - 1, 64, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+            unsigned int *i = &indices[r * band];
+            for (unsigned int s = 0; s < segments-1; s++) {
+                *i++ = r * segments + s;
+                *i++ = r * segments + (s + 1);
+                *i++ = (r+1) * segments + (s + 1);
+                *i++ = (r+1) * segments + (s + 1);
+                *i++ = (r+1) * segments + s;
+                *i++ = r * segments + s;
+            }
+        }
+    });
 
-            float const x = cos(2*pi * s * S) * sin( pi * r * R );
-            float const y = sin( -pi/2 + pi * r * R );
-            float const z = sin(2*pi * s * S) * sin( pi * r * R );
+    return MeshData{std::move(vertices), std::move(indices)};
+}
 
-            vertices[index].position.x = x * radius;
-            vertices[index].position.y = y * radius;
-            vertices[index].position.z = z * radius;
+void MeshLod::addLevel(const Mesh &mesh) {
+    for (const Vertex &vertex : mesh.vertices)
+        radius = std::max(radius, glm::length(vertex.position));
+    triangleCounts.push_back(mesh.triangleCount());
+    levels.push_back(&mesh);
+}
 
-            vertices[index].normal.x = x * radius;
-            vertices[index].normal.y = y * radius;
-            vertices[index].normal.z = z * radius;
+void MeshLod::clear() {
+    levels.clear();
+    triangleCounts.clear();
+    radius = 0.0f;
+    current = 0;
+}
 
-            vertices[index].texCoords.x = r*S;
-            vertices[index].texCoords.y = s*R;
-            index++;
-        }
+float MeshLod::triangleSize(int index, float screenRadius) const {
+    // About half of a closed surface faces the camera and covers the projected disc
+    auto pi = glm::pi<float>();
+    size_t visible = std::max<size_t>(triangleCounts[index] / 2, 1);
+    float area = pi * screenRadius * screenRadius / visible;
+    // Edge of a right isosceles triangle with that area
+    return std::sqrt(2.0f * area);
+}
 
-    auto i = indices.begin();
-    for (int r = 0; r < rings-1; r++)
-        for (int s = 0; s < segments-1; s++) {
-            *i++ = r * segments + s;
-            *i++ = r * segments + (s + 1);
-            *i++ = (r+1) * segments + (s + 1);
-            *i++ = (r+1) * segments + (s + 1);
-            *i++ = (r+1) * segments + s;
-            *i++ = r * segments + s;
-        }
+float MeshLod::screenRadius(float radius, float distance, float fovY, float viewportHeight) {
+    // Inside the bounding sphere the surface fills the view
+    if (distance <= radius)
+        return viewportHeight;
+    return radius / (distance * std::tan(fovY * 0.5f)) * viewportHeight * 0.5f;
+}
 
-    return Mesh(vertices, indices);
+int MeshLod::select(float screenRadius, float targetPixels, float hysteresis) {
+    if (levels.empty())
+        return current;
+
+    // Triangles grow with every coarser level, the last level that fits limit is the coarsest one
+    auto coarsestWithin = [&](float limit) {
+        int fit = 0;
+        for (int i = 0; i < (int)levels.size(); i++)
+            if (triangleSize(i, screenRadius) <= limit)
+                fit = i;
+        return fit;
+    };
+
+    current = std::min(current, (int)levels.size() - 1);
+    if (triangleSize(current, screenRadius) > targetPixels * (1.0f + hysteresis)) {
+        current = coarsestWithin(targetPixels);
+    } else {
+        int coarser = coarsestWithin(targetPixels * (1.0f - hysteresis));
+        if (coarser > current)
+            current = coarser;
+    }
+    return current;
 }
 
-Mesh generatePlane(float width) {
+MeshData planeData(float width) {
     std::vector<Vertex> vertices(4);
     float halfWidth = width / 2;
     vertices[0].position.x = 1 * halfWidth;
@@ -186,5 +887,132 @@ Mesh generatePlane(float width) {
     indices[4] = 3;
     indices[5] = 0;
 
-    return Mesh(vertices, indices);
+    return MeshData{std::move(vertices), std::move(indices)};
+}
+
+MeshData icosphereData(float radius, unsigned int subdivisions) {
+    // Icosahedron from three orthogonal golden rectangles
+    const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    std::vector<glm::vec3> positions = {
+        {-1,  t,  0}, { 1,  t,  0}, {-1, -t,  0}, { 1, -t,  0},
+        { 0, -1,  t}, { 0,  1,  t}, { 0, -1, -t}, { 0,  1, -t},
+        { t,  0, -1}, { t,  0,  1}, {-t,  0, -1}, {-t,  0,  1}
+    };
+    std::vector<unsigned int> indices = {
+        0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+        1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+        3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+        4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+    };
+
+    // Each edge is split once, the triangle on its other side reuses the midpoint
+    for (unsigned int level = 0; level < subdivisions; level++) {
+        std::unordered_map<uint64_t, unsigned int> midpoints;
+        auto midpoint = [&](unsigned int a, unsigned int b) {
+            uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            auto found = midpoints.find(key);
+            if (found != midpoints.end())
+                return found->second;
+
+            glm::vec3 position = glm::normalize(positions[a] + positions[b]) * glm::length(positions[a]);
+            positions.push_back(position);
+            midpoints.emplace(key, (unsigned int)positions.size() - 1);
+            return (unsigned int)positions.size() - 1;
+        };
+
+        std::vector<unsigned int> subdivided;
+        subdivided.reserve(indices.size() * 4);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            subdivided.insert(subdivided.end(), {a, ab, ca,   b, bc, ab,   c, ca, bc,   ab, bc, ca});
+        }
+        indices = std::move(subdivided);
+    }
+
+    std::vector<Vertex> vertices(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+        vertices[i] = sphereVertex(positions[i], radius);
+
+    MeshData data{std::move(vertices), std::move(indices)};
+    splitSphereSeam(data);
+    return data;
+}
+
+MeshData cubeSphereData(float radius, unsigned int n) {
+    n = std::max(n, 1u);
+
+    // Faces walk an (n+1)^3 lattice, right x up points outwards so every face winds the same way
+    struct Face { glm::ivec3 origin, right, up; };
+    const int m = (int)n;
+    const Face faces[6] = {
+        {{m, 0, 0}, {0, 1, 0}, {0, 0, 1}},  // +X
+        {{0, 0, 0}, {0, 0, 1}, {0, 1, 0}},  // -X
+        {{0, m, 0}, {0, 0, 1}, {1, 0, 0}},  // +Y
+        {{0, 0, 0}, {1, 0, 0}, {0, 0, 1}},  // -Y
+        {{0, 0, m}, {1, 0, 0}, {0, 1, 0}},  // +Z
+        {{0, 0, 0}, {0, 1, 0}, {1, 0, 0}}   // -Z
+    };
+
+    // Lattice points on the cube edges belong to several faces but become one vertex
+    std::unordered_map<uint64_t, unsigned int> lattice;
+    std::vector<Vertex> vertices;
+    auto vertexAt = [&](glm::ivec3 point) {
+        uint64_t key = ((uint64_t)point.x * (n + 1) + point.y) * (n + 1) + point.z;
+        auto found = lattice.find(key);
+        if (found != lattice.end())
+            return found->second;
+
+        // Spherified cube mapping, spreads the vertices more evenly than normalizing the cube
+        glm::vec3 p = glm::vec3(point.x, point.y, point.z) * (2.0f / n) - glm::vec3(1.0f);
+        glm::vec3 p2 = p * p;
+        glm::vec3 direction(p.x * std::sqrt(1.0f - p2.y / 2 - p2.z / 2 + p2.y * p2.z / 3),
+                            p.y * std::sqrt(1.0f - p2.z / 2 - p2.x / 2 + p2.z * p2.x / 3),
+                            p.z * std::sqrt(1.0f - p2.x / 2 - p2.y / 2 + p2.x * p2.y / 3));
+
+        vertices.push_back(sphereVertex(direction, radius));
+        lattice.emplace(key, (unsigned int)vertices.size() - 1);
+        return (unsigned int)vertices.size() - 1;
+    };
+
+    std::vector<unsigned int> indices;
+    indices.reserve(6 * n * n * 6);
+    for (const Face &face : faces)
+        for (int j = 0; j < m; j++)
+            for (int i = 0; i < m; i++) {
+                glm::ivec3 corner = face.origin + face.right * i + face.up * j;
+                unsigned int a = vertexAt(corner);
+                unsigned int b = vertexAt(corner + face.right);
+                unsigned int c = vertexAt(corner + face.right + face.up);
+                unsigned int d = vertexAt(corner + face.up);
+                indices.insert(indices.end(), {a, b, c,   c, d, a});
+            }
+
+    MeshData data{std::move(vertices), std::move(indices)};
+    splitSphereSeam(data);
+    return data;
+}
+
+Mesh generateSphere(float radius, unsigned int rings, unsigned int segments) {
+    MeshData data = sphereData(radius, rings, segments);
+    computeTangents(data);
+    return Mesh(std::move(data));
+}
+
+Mesh generateIcosphere(float radius, unsigned int subdivisions) {
+    MeshData data = icosphereData(radius, subdivisions);
+    computeTangents(data);
+    return Mesh(std::move(data));
+}
+
+Mesh generateCubeSphere(float radius, unsigned int n) {
+    MeshData data = cubeSphereData(radius, n);
+    computeTangents(data);
+    return Mesh(std::move(data));
+}
+
+Mesh generatePlane(float width) {
+    MeshData data = planeData(width);
+    computeTangents(data);
+    return Mesh(std::move(data));
 }
@@ -1,25 +1,136 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
+#include <memory>
 #include <glad.h>
 #include "Shader.h"
+#include "GpuArena.h"
 
 struct Vertex {
     glm::vec3 position;
     glm::vec3 normal;
     glm::vec2 texCoords;
+    glm::vec4 tangent = glm::vec4(0.0f);    // xyz tangent, w handedness of the bitangent, see MeshData::tangents
 };
 
+// Vertex layouts in GPU memory, decoded by shaders/include/vertexInput.glsl
+enum class VertexFormat {
+    Float,      // 48 bytes: float position, normal, uv and tangent
+    Half,       // 16 bytes: half float position, octahedral snorm16 normal, unorm16 uv, tangent angle
+    Snorm16     // 16 bytes: snorm16 position relative to the bounds, octahedral snorm16 normal, unorm16 uv, tangent angle
+};
+
+// Layout of the Half and Snorm16 formats
+struct PackedVertex {
+    // w holds the tangent as an angle around the normal in the low 15 bits, the top bit is set
+    // for a negative handedness. It keeps positions 4 byte aligned and is not read as position.
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t texCoords[2];
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
 struct Texture {
     unsigned int id;
     std::string type;
 };
 
+// CPU side geometry, produced by the generators before it is uploaded into a Mesh.
+// Triangle strips are separated by RESTART_INDEX.
+struct MeshData {
+    static const unsigned int RESTART_INDEX = 0xFFFFFFFF;
+
+    std::vector<Vertex>       vertices;
+    std::vector<unsigned int> indices;
+    GLenum                    primitive = GL_TRIANGLES;    // GL_TRIANGLES or GL_TRIANGLE_STRIP
+    bool                      tangents = false;            // Vertex::tangent is filled, see computeTangents()
+};
+
+// Geometry encoded in its GPU layout. Built by Mesh::prepare() without any GL calls,
+// so it can be produced on a worker thread and uploaded later in slices.
+struct MeshUpload {
+    MeshData data;
+    VertexFormat format = VertexFormat::Float;
+    std::vector<PackedVertex> packed;           // Empty for Float, data.vertices is uploaded as is
+    GLenum indexType = GL_UNSIGNED_INT;
+    std::vector<unsigned char> narrowIndices;   // Empty for 32-bit indices, data.indices is uploaded as is
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec4 texCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+
+    size_t vertexWritten = 0;     // Bytes already in the buffers
+    size_t indexWritten = 0;
+};
+
+// Placement of one float attribute in a vertex buffer laid out by someone else, e.g. a glTF buffer view
+struct VertexAttribute {
+    bool enabled = false;       // Disabled attributes read a constant: zero uvs, +y normals
+    size_t offset = 0;          // Bytes from the start of the vertex data
+    int stride = 0;
+};
+
+// Geometry already in its GPU layout in memory owned by someone else, e.g. a mapped mesh archive.
+// It is handed to the buffers as it is, the mesh keeps no CPU copy.
+struct EncodedMesh {
+    VertexFormat format = VertexFormat::Float;
+    GLenum primitive = GL_TRIANGLES;
+    const void *vertexData = nullptr;
+    size_t vertexBytes = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    const void *indexData = nullptr;
+    size_t indexCount = 0;
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec4 texCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+    bool tangents = false;
+    // Float only: attributes at arbitrary offsets and strides instead of interleaved Vertex structs
+    bool customLayout = false;
+    VertexAttribute position, texCoords, normal, tangent;
+};
+
+// Per-instance attributes of an instanced draw: count instances of vec4Count tightly packed vec4s
+// each, read from buffer into consecutive locations from Mesh::INSTANCE_LOCATION on. A mat4 takes four.
+struct InstanceBuffer {
+    unsigned int buffer = 0;
+    int vec4Count = 0;
+    int count = 0;
+};
+
+// Layout of one command read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;    // Also offsets the instanced attributes
+};
+
+// maxDraws commands from offset in buffer, meshes sharing the draw state of the one drawing them.
+// With a countBuffer the draw count is read from it at countOffset, otherwise all maxDraws run.
+struct IndirectCommands {
+    unsigned int buffer = 0;
+    size_t offset = 0;
+    int maxDraws = 0;
+    unsigned int countBuffer = 0;
+    size_t countOffset = 0;
+};
+
 /*
  * Basic mesh class based on code from learnopengl.com
  *
+ * Owns its ranges of the GpuArena buffers and its textures and is move-only.
+ * upload() moves the geometry into new ranges, the old ones are retired until
+ * the GPU is done drawing them. Meshes of one vertex format share a vertex
+ * array and are drawn with base vertex offsets.
+ *
+ * beginUpload() and continueUpload() split an upload over several frames,
+ * the mesh is not drawn until the last slice is written. Stage into a second
+ * mesh and swap to keep showing the old geometry meanwhile.
+ *
  * */
 
 class Mesh {
@@ -28,19 +139,135 @@ public:
     std::vector<Vertex>       vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture>      textures;
-    unsigned int VAO;
+    unsigned int VAO = 0;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices);
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, VertexFormat format = VertexFormat::Float);
+    explicit Mesh(MeshData data, VertexFormat format = VertexFormat::Float);
     //Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
+    ~Mesh();
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh &&other) noexcept;
+    Mesh& operator=(Mesh &&other) noexcept;
+
+    void upload(MeshData data);
+    void upload(MeshData data, VertexFormat format);
+    void upload(const EncodedMesh &encoded);
+    static MeshUpload prepare(MeshData data, VertexFormat format);
+    void beginUpload(MeshUpload upload);
+    // Writes at most budget bytes, true once the new geometry is in place
+    bool continueUpload(size_t budget);
+    bool uploading() const { return staged != nullptr; }
+    VertexFormat vertexFormat() const { return format; }
+    bool hasTangents() const { return tangents; }
+    static size_t vertexSize(VertexFormat format);
+
+    GLenum primitiveType() const { return primitive; }
+    size_t triangleCount() const;
+    // Size of one index in the element buffer, picked from the vertex count
+    size_t indexSize() const;
+    size_t indexBytes() const { return indexCount * indexSize(); }
+    // Bytes of arena storage owned by this mesh
+    size_t gpuSize() const { return vertexRange.size + indexRange.size; }
+    // Bytes of the CPU copies kept in vertices and indices
+    size_t cpuSize() const { return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int); }
     void loadTexture(const char *path, std::string type);
     void draw(Shader &shader, GLenum mode) const;
+    // Draws every instance with one call, locations 0 to 3 stay per vertex
+    void drawInstanced(Shader &shader, GLenum mode, const InstanceBuffer &instances) const;
+    static const unsigned int INSTANCE_LOCATION = 4;
+    // Draws the indirect commands with this mesh's vertex array, textures and decode parameters.
+    // Instances index the instance buffer through their base instance, count is ignored.
+    void drawIndirect(Shader &shader, GLenum mode, const InstanceBuffer &instances, const IndirectCommands &commands) const;
+    // Command drawing this mesh once
+    DrawElementsIndirectCommand indirectCommand() const;
+    // True if both meshes can be drawn by one multi-draw: same vertex array, primitive, index type
+    // and decode parameters
+    bool sharesDrawState(const Mesh &other) const;
+
+    // Arena range allocations and bytes currently held by all meshes
+    static int allocations;
+    static size_t gpuBytes;
 private:
     //  render data
-    unsigned int VBO, EBO;
+    GpuRange vertexRange{GpuPool::Vertex};
+    GpuRange indexRange{GpuPool::Index};
+    bool ownsVertexArray = false;   // Only custom layouts, other vertex arrays belong to the arena
+
+    VertexFormat format;
+    GLenum primitive = GL_TRIANGLES;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t indexCount = 0;
+    // Decode parameters of the compact formats, identity for Float
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec4 texCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+    bool tangents = false;
+    bool customLayout = false;
+    VertexAttribute positionAttribute, texCoordAttribute, normalAttribute, tangentAttribute;
+    std::unique_ptr<MeshUpload> staged;
 
     void setupMesh();
+    static std::vector<PackedVertex> packVertices(const std::vector<Vertex> &vertices, MeshUpload &upload);
+    void setupVertexArray();
+    void setupAttributes(size_t baseOffset) const;
+    GLint baseVertex() const;
+    void bindInstances(const InstanceBuffer &instances) const;
+    void unbindInstances(const InstanceBuffer &instances) const;
+    GLenum beginDraw(Shader &shader, GLenum mode) const;
+    void endDraw() const;
+    void release();
+};
+
+/*
+ * Chain of tessellations of one surface, finest first. select() picks the
+ * coarsest level whose triangles still project to at most the target size in
+ * pixels. Switching only happens once a level is clearly past the target, so
+ * small camera moves around a boundary do not pop between levels.
+ *
+ * The chain does not own its levels, they have to outlive it or be cleared
+ * from it first.
+ *
+ * */
+
+class MeshLod {
+public:
+    // Levels are added from finest to coarsest
+    void addLevel(const Mesh &mesh);
+    void clear();
+
+    int select(float screenRadius, float targetPixels, float hysteresis = 0.25f);
+    int currentLevel() const { return current; }
+    size_t levelCount() const { return levels.size(); }
+    const Mesh& level(int index) const { return *levels[index]; }
+    size_t triangles(int index) const { return triangleCounts[index]; }
+
+    // Average edge in pixels of the triangles facing the camera, from the projected area they share
+    float triangleSize(int index, float screenRadius) const;
+    // Bounding sphere radius around the mesh origin, over all levels
+    float boundingRadius() const { return radius; }
+    // Projected radius in pixels of a sphere at distance from a perspective camera
+    static float screenRadius(float radius, float distance, float fovY, float viewportHeight);
+
+private:
+    std::vector<const Mesh*> levels;
+    std::vector<size_t> triangleCounts;
+    float radius = 0.0f;
+    int current = 0;
 };
 
 // Functions to generate primitive meshes
+// With strips every ring band is one triangle strip, joined by primitive restart.
+// Sine and cosine come from per ring and per segment tables, rings are filled in parallel.
+MeshData sphereData(float radius, unsigned int rings = 16, unsigned int segments = 32, bool strips = false);
+// Uniform density spheres, every vertex is shared by all triangles using it except along the uv seam
+// and on the poles, those are split so no triangle's uvs wrap
+MeshData icosphereData(float radius, unsigned int subdivisions = 3);
+MeshData cubeSphereData(float radius, unsigned int n = 8);
+MeshData planeData(float width = 1);
+// Uploaded meshes of the shapes above, with tangents for normal mapping
 Mesh generateSphere(float radius, unsigned int rings = 16, unsigned int segments = 32);
+Mesh generateIcosphere(float radius, unsigned int subdivisions = 3);
+Mesh generateCubeSphere(float radius, unsigned int n = 8);
 Mesh generatePlane(float width = 1);
\ No newline at end of file
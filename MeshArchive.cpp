@@ -0,0 +1,218 @@
+#include "MeshArchive.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+std::string MeshArchive::directory = "mesh_cache";
+int MeshArchive::hits = 0;
+int MeshArchive::misses = 0;
+
+namespace {
+    const char ARCHIVE_MAGIC[8] = {'S', 'E', 'M', 'E', 'S', 'H', 0, 0};
+    const uint32_t ARCHIVE_VERSION = 3;
+    const uint64_t STREAM_ALIGNMENT = 4096;
+    // Sources are hashed in blocks of this size in parallel, then the block hashes are combined
+    const size_t HASH_BLOCK = 1 << 20;
+
+    // FNV-1a, 64 bit
+    uint64_t hashBytes(uint64_t hash, const char *data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (uint8_t)data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t alignUp(uint64_t offset) {
+        return (offset + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+    }
+
+    std::string entryPath(uint64_t hash) {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+        return MeshArchive::directory + "/" + hex + ".mesh";
+    }
+
+    size_t indexSize(uint32_t indexType) {
+        return indexType == GL_UNSIGNED_BYTE ? 1 : indexType == GL_UNSIGNED_SHORT ? 2 : indexType == GL_UNSIGNED_INT ? 4 : 0;
+    }
+}
+
+bool MeshArchive::open(const std::string &path) {
+    file = std::make_unique<MappedFile>(path);
+    if (!file->data || file->size < sizeof(MeshArchiveHeader)) {
+        file.reset();
+        return false;
+    }
+
+    // Counts are checked by dividing the byte sizes, a count times a stride could wrap around
+    const MeshArchiveHeader &h = header();
+    bool valid = std::memcmp(h.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0 && h.version == ARCHIVE_VERSION &&
+                 h.vertexFormat <= (uint32_t)VertexFormat::Snorm16 && indexSize(h.indexType) != 0 &&
+                 (h.primitive == GL_TRIANGLES || h.primitive == GL_TRIANGLE_STRIP);
+    if (valid) {
+        const size_t vertexStride = Mesh::vertexSize((VertexFormat)h.vertexFormat), indexStride = indexSize(h.indexType);
+        valid = h.vertexBytes % vertexStride == 0 && h.vertexCount == h.vertexBytes / vertexStride &&
+                h.indexBytes % indexStride == 0 && h.indexCount == h.indexBytes / indexStride &&
+                h.vertexOffset <= file->size && h.vertexBytes <= file->size - h.vertexOffset &&
+                h.indexOffset <= file->size && h.indexBytes <= file->size - h.indexOffset;
+    }
+    if (!valid) {
+        std::cerr << "ERROR::MESH_ARCHIVE::INVALID: " << path << std::endl;
+        file.reset();
+    }
+    return valid;
+}
+
+EncodedMesh MeshArchive::encoded() const {
+    const MeshArchiveHeader &h = header();
+    EncodedMesh mesh;
+    mesh.format = (VertexFormat)h.vertexFormat;
+    mesh.primitive = h.primitive;
+    mesh.vertexData = file->data + h.vertexOffset;
+    mesh.vertexBytes = h.vertexBytes;
+    mesh.indexType = h.indexType;
+    mesh.indexData = file->data + h.indexOffset;
+    mesh.indexCount = h.indexCount;
+    mesh.positionScale = glm::vec3(h.positionScale[0], h.positionScale[1], h.positionScale[2]);
+    mesh.positionOffset = glm::vec3(h.positionOffset[0], h.positionOffset[1], h.positionOffset[2]);
+    mesh.texCoordTransform = glm::vec4(h.texCoordTransform[0], h.texCoordTransform[1],
+                                       h.texCoordTransform[2], h.texCoordTransform[3]);
+    mesh.tangents = h.tangents != 0;
+    return mesh;
+}
+
+bool MeshArchive::write(const std::string &path, const MeshUpload &upload, uint64_t sourceHash,
+                        glm::vec3 boundsMin, glm::vec3 boundsMax) {
+    const MeshData &data = upload.data;
+    const void *vertexData = upload.format == VertexFormat::Float ? (const void*)data.vertices.data() : (const void*)upload.packed.data();
+    const void *indexData = upload.indexType == GL_UNSIGNED_INT ? (const void*)data.indices.data() : (const void*)upload.narrowIndices.data();
+
+    MeshArchiveHeader h{};
+    std::memcpy(h.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    h.version = ARCHIVE_VERSION;
+    h.vertexFormat = (uint32_t)upload.format;
+    h.primitive = data.primitive;
+    h.indexType = upload.indexType;
+    h.sourceHash = sourceHash;
+    h.vertexCount = data.vertices.size();
+    h.indexCount = data.indices.size();
+    h.vertexOffset = alignUp(sizeof(MeshArchiveHeader));
+    h.vertexBytes = h.vertexCount * Mesh::vertexSize(upload.format);
+    h.indexOffset = alignUp(h.vertexOffset + h.vertexBytes);
+    h.indexBytes = h.indexCount * indexSize(upload.indexType);
+    for (int i = 0; i < 3; i++) {
+        h.boundsMin[i] = boundsMin[i];
+        h.boundsMax[i] = boundsMax[i];
+        h.positionScale[i] = upload.positionScale[i];
+        h.positionOffset[i] = upload.positionOffset[i];
+    }
+    for (int i = 0; i < 4; i++)
+        h.texCoordTransform[i] = upload.texCoordTransform[i];
+    h.tangents = data.tangents;
+
+    // Written next to the final name and renamed, so a crash never leaves a truncated archive behind
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        std::vector<char> padding(STREAM_ALIGNMENT, 0);
+        out.write((const char*)&h, sizeof(h));
+        out.write(padding.data(), h.vertexOffset - sizeof(h));
+        out.write((const char*)vertexData, h.vertexBytes);
+        out.write(padding.data(), h.indexOffset - h.vertexOffset - h.vertexBytes);
+        out.write((const char*)indexData, h.indexBytes);
+        if (!out) {
+            std::cerr << "ERROR::MESH_ARCHIVE::WRITE_FAILED: " << path << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "ERROR::MESH_ARCHIVE::WRITE_FAILED: " << path << " " << error.message() << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+uint64_t MeshArchive::sourceHash(const char *data, size_t size, VertexFormat format) {
+    size_t blocks = (size + HASH_BLOCK - 1) / HASH_BLOCK;
+    std::vector<uint64_t> blockHashes(blocks);
+    parallelFor(blocks, 1, [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; b++) {
+            size_t offset = b * HASH_BLOCK;
+            blockHashes[b] = hashBytes(14695981039346656037ull, data + offset, std::min(HASH_BLOCK, size - offset));
+        }
+    });
+
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashBytes(hash, (const char*)blockHashes.data(), blockHashes.size() * sizeof(uint64_t));
+    hash = hashBytes(hash, (const char*)&size, sizeof(size));
+    uint32_t formatId = (uint32_t)format;
+    hash = hashBytes(hash, (const char*)&formatId, sizeof(formatId));
+    return hashBytes(hash, (const char*)&ARCHIVE_VERSION, sizeof(ARCHIVE_VERSION));
+}
+
+bool MeshArchive::import(const std::string &path, VertexFormat format, Mesh &mesh, LoadStats *stats) {
+    auto start = std::chrono::steady_clock::now();
+
+    uint64_t hash;
+    size_t sourceBytes;
+    {
+        MappedFile source(path);
+        if (!source.data) {
+            std::cerr << "ERROR::MESH_ARCHIVE::FILE_NOT_READ: " << path << std::endl;
+            return false;
+        }
+        hash = sourceHash(source.data, source.size, format);
+        sourceBytes = source.size;
+    }
+
+    std::string archivePath = entryPath(hash);
+    MeshArchive archive;
+    if (std::filesystem::exists(archivePath) && archive.open(archivePath) && archive.header().sourceHash == hash) {
+        hits++;
+        mesh.upload(archive.encoded());
+        if (stats) {
+            const MeshArchiveHeader &h = archive.header();
+            stats->bytes = sourceBytes;
+            stats->vertices = h.vertexCount;
+            stats->triangles = mesh.triangleCount();
+            stats->chunks = 0;
+            stats->archived = true;
+            stats->boundsMin = glm::vec3(h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]);
+            stats->boundsMax = glm::vec3(h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]);
+            stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        return true;
+    }
+    misses++;
+
+    MeshData data;
+    LoadStats loaded;
+    if (!loadMesh(path, data, &loaded))
+        return false;
+
+    MeshUpload upload = Mesh::prepare(std::move(data), format);
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    write(archivePath, upload, hash, loaded.boundsMin, loaded.boundsMax);
+
+    mesh.beginUpload(std::move(upload));
+    mesh.continueUpload(std::numeric_limits<size_t>::max());
+    if (stats) {
+        *stats = loaded;
+        stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
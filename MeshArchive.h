@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "Mesh.h"
+#include "MeshLoader.h"
+#include "MappedFile.h"
+
+// Fixed size header at the start of an archive, all fields little endian
+struct MeshArchiveHeader {
+    char magic[8];              // "SEMESH\0\0"
+    uint32_t version;
+    uint32_t vertexFormat;      // VertexFormat
+    uint32_t primitive;         // GL_TRIANGLES or GL_TRIANGLE_STRIP
+    uint32_t indexType;         // GL_UNSIGNED_BYTE, _SHORT or _INT
+    uint64_t sourceHash;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t vertexOffset;      // Byte offsets from the start of the file, page aligned
+    uint64_t vertexBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+    float boundsMin[3];
+    float boundsMax[3];
+    float positionScale[3];     // Decode parameters of the compact vertex formats
+    float positionOffset[3];
+    float texCoordTransform[4];
+    uint32_t tangents;          // 1 if the vertices carry tangents
+    uint8_t reserved[44];
+};
+
+static_assert(sizeof(MeshArchiveHeader) == 192, "MeshArchiveHeader layout changed, bump the version");
+
+/*
+ * Binary mesh container holding a header, the vertex stream and the index
+ * stream exactly as they are uploaded to the GPU. Streams start on page
+ * boundaries, so a mapped archive is handed to glBufferData without any
+ * parsing or copying.
+ *
+ * Imported OBJ and PLY files are converted into archives in a cache directory,
+ * keyed by a hash of the source file contents and the vertex format.
+ *
+ * */
+
+class MeshArchive {
+public:
+    // Maps an archive and checks its header and stream sizes, false if it is not a valid archive
+    bool open(const std::string &path);
+    const MeshArchiveHeader& header() const { return *reinterpret_cast<const MeshArchiveHeader*>(file->data); }
+    // Points into the mapping, valid as long as the archive is open
+    EncodedMesh encoded() const;
+
+    static bool write(const std::string &path, const MeshUpload &upload, uint64_t sourceHash,
+                      glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+    // Loads path through the archive cache, parsing and converting it only on a miss
+    static bool import(const std::string &path, VertexFormat format, Mesh &mesh, LoadStats *stats = nullptr);
+    static uint64_t sourceHash(const char *data, size_t size, VertexFormat format);
+
+    static std::string directory;
+    static int hits;
+    static int misses;
+
+private:
+    std::unique_ptr<MappedFile> file;
+};
@@ -0,0 +1,87 @@
+#include "MeshBuilder.h"
+
+#include <chrono>
+
+MeshBuilder::MeshBuilder() {
+    worker = std::thread(&MeshBuilder::run, this);
+}
+
+MeshBuilder::~MeshBuilder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void MeshBuilder::request(Job job, VertexFormat format) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queued)
+            dropped++;
+        queued = std::move(job);
+        queuedFormat = format;
+        requested++;
+    }
+    wake.notify_one();
+}
+
+void MeshBuilder::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queued)
+        dropped++;
+    queued = nullptr;
+    // Results are only accepted for the latest id, an id nobody builds rejects them all
+    requested++;
+}
+
+bool MeshBuilder::poll(BuiltMesh &result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!hasResult)
+        return false;
+
+    hasResult = false;
+    if (finishedId != requested) {
+        dropped++;
+        return false;
+    }
+    result = std::move(finished);
+    return true;
+}
+
+bool MeshBuilder::busy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued || building || hasResult;
+}
+
+void MeshBuilder::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stopping || queued; });
+        if (stopping)
+            return;
+
+        Job job = std::move(queued);
+        queued = nullptr;
+        VertexFormat format = queuedFormat;
+        building = requested;
+        lock.unlock();
+
+        // Everything up to the GL upload happens here, off the render thread
+        auto start = std::chrono::steady_clock::now();
+        BuiltMesh built;
+        MeshData data = job(built.report);
+        built.upload = Mesh::prepare(std::move(data), format);
+        built.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        // A result nobody polled yet is overwritten, it belongs to an older request
+        if (hasResult)
+            dropped++;
+        finished = std::move(built);
+        finishedId = building;
+        hasResult = true;
+        building = 0;
+    }
+}
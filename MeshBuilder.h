@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+// Finished geometry of one request, ready for Mesh::beginUpload()
+struct BuiltMesh {
+    MeshUpload upload;
+    OptimizeReport report;
+    double milliseconds = 0.0;     // Generation, optimization and encoding on the worker
+};
+
+/*
+ * Builds meshes on a worker thread. Only the latest request matters: a request
+ * that has not started yet is replaced by the next one, and a result that was
+ * overtaken by a newer request is dropped, so a fast slider drag only builds
+ * the first and the last mesh.
+ *
+ * */
+
+class MeshBuilder {
+public:
+    // Generates the geometry and fills report if it optimizes it, runs on the worker thread
+    using Job = std::function<MeshData(OptimizeReport &report)>;
+
+    MeshBuilder();
+    ~MeshBuilder();
+
+    MeshBuilder(const MeshBuilder&) = delete;
+    MeshBuilder& operator=(const MeshBuilder&) = delete;
+
+    void request(Job job, VertexFormat format);
+    // Drops the queued request and the result of the one being built
+    void cancel();
+    // Takes the result of the latest request once it is done
+    bool poll(BuiltMesh &result);
+    // A request is queued, building or finished but not polled yet
+    bool busy() const;
+
+    // Requests replaced before they were built or whose result came too late
+    int dropped = 0;
+
+private:
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    Job queued;
+    VertexFormat queuedFormat = VertexFormat::Float;
+    uint64_t requested = 0;     // Id of the latest request
+    uint64_t building = 0;      // Id of the request on the worker, 0 if idle
+    uint64_t finishedId = 0;
+    bool hasResult = false;
+    BuiltMesh finished;
+
+    void run();
+};
@@ -0,0 +1,80 @@
+#include "MeshCache.h"
+
+#include <cstdint>
+#include <cstring>
+
+bool MeshKey::operator==(const MeshKey &other) const {
+    return generator == other.generator && radius == other.radius && rings == other.rings &&
+           segments == other.segments && format == other.format && strips == other.strips &&
+           optimized == other.optimized;
+}
+
+size_t MeshKeyHash::operator()(const MeshKey &key) const {
+    uint32_t radiusBits;
+    std::memcpy(&radiusBits, &key.radius, sizeof(radiusBits));
+    uint32_t fields[] = {(uint32_t)key.generator, radiusBits, (uint32_t)key.rings, (uint32_t)key.segments,
+                         (uint32_t)key.format, (uint32_t)key.strips, (uint32_t)key.optimized};
+
+    // FNV-1a over the fields
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t field : fields) {
+        hash ^= field;
+        hash *= 1099511628211ull;
+    }
+    return (size_t)hash;
+}
+
+MeshCache::MeshCache(size_t budget) : byteBudget(budget) {}
+
+CachedMesh* MeshCache::find(const MeshKey &key) {
+    auto found = lookup.find(key);
+    if (found == lookup.end()) {
+        misses++;
+        return nullptr;
+    }
+
+    hits++;
+    entries.splice(entries.begin(), entries, found->second);
+    return &*found->second;
+}
+
+CachedMesh& MeshCache::insert(const MeshKey &key, Mesh mesh, const OptimizeReport &report, double milliseconds,
+                              const CachedMesh *inUse, bool pin) {
+    // Pointers to the cached entry may be in use, so it stays as it is
+    auto found = lookup.find(key);
+    if (found != lookup.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+        entries.front().pins += pin;
+        return entries.front();
+    }
+
+    entries.push_front(CachedMesh{key, std::move(mesh), report, milliseconds, pin ? 1 : 0});
+    lookup[key] = entries.begin();
+    usedBytes += entrySize(entries.front());
+
+    evict(&entries.front(), inUse);
+    return entries.front();
+}
+
+void MeshCache::setBudget(size_t bytes, const CachedMesh *inUse) {
+    byteBudget = bytes;
+    evict(nullptr, inUse);
+}
+
+size_t MeshCache::entrySize(const CachedMesh &entry) {
+    return entry.mesh.gpuSize() + entry.mesh.cpuSize();
+}
+
+void MeshCache::evict(const CachedMesh *keep, const CachedMesh *inUse) {
+    auto entry = entries.end();
+    while (usedBytes > byteBudget && entry != entries.begin()) {
+        --entry;
+        if (&*entry == keep || &*entry == inUse || entry->pins > 0)
+            continue;
+
+        usedBytes -= entrySize(*entry);
+        lookup.erase(entry->key);
+        entry = entries.erase(entry);
+        evictions++;
+    }
+}
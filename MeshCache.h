@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+// Everything that decides the contents of a generated mesh
+struct MeshKey {
+    int generator = 0;          // Tessellation, e.g. UV sphere or icosphere
+    float radius = 1.0f;
+    int rings = 0;              // Or the subdivision level, or the cells per cube face edge
+    int segments = 0;
+    VertexFormat format = VertexFormat::Float;
+    bool strips = false;
+    bool optimized = false;
+
+    bool operator==(const MeshKey &other) const;
+};
+
+struct MeshKeyHash {
+    size_t operator()(const MeshKey &key) const;
+};
+
+struct CachedMesh {
+    MeshKey key;
+    Mesh mesh;
+    OptimizeReport report;
+    double milliseconds = 0.0;  // Time it took to build
+    int pins = 0;               // Pinned entries are never evicted, e.g. while a MeshLod refers to them
+};
+
+/*
+ * Generated meshes kept on the GPU, least recently used first out once their
+ * buffers and CPU copies exceed the budget. Entries never move, so a CachedMesh pointer stays
+ * valid until that entry is evicted, and pinned entries are not evicted at all.
+ *
+ * */
+
+class MeshCache {
+public:
+    explicit MeshCache(size_t budget);
+
+    // Marks the entry as most recently used, nullptr on a miss
+    CachedMesh* find(const MeshKey &key);
+    // Neither counts as a hit or miss nor changes the order
+    bool contains(const MeshKey &key) const { return lookup.count(key) != 0; }
+    // Adds an entry, then evicts down to the budget except for the new entry and inUse.
+    // An entry already cached under key is kept and returned, mesh is dropped. With pin
+    // the returned entry is pinned before anything is evicted.
+    CachedMesh& insert(const MeshKey &key, Mesh mesh, const OptimizeReport &report, double milliseconds,
+                       const CachedMesh *inUse = nullptr, bool pin = false);
+
+    void setBudget(size_t bytes, const CachedMesh *inUse = nullptr);
+    size_t budget() const { return byteBudget; }
+    size_t bytes() const { return usedBytes; }
+    size_t size() const { return entries.size(); }
+
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    unsigned long long evictions = 0;
+
+private:
+    size_t byteBudget;
+    size_t usedBytes = 0;
+    std::list<CachedMesh> entries;      // Most recently used first
+    std::unordered_map<MeshKey, std::list<CachedMesh>::iterator, MeshKeyHash> lookup;
+
+    // Cached meshes keep their CPU copies, for the LOD radius and strip triangle counts
+    static size_t entrySize(const CachedMesh &entry);
+    void evict(const CachedMesh *keep, const CachedMesh *inUse);
+};
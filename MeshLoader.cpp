@@ -0,0 +1,766 @@
+#include "MeshLoader.h"
+#include "Parallel.h"
+#include "MappedFile.h"
+#include "MeshTangents.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+    // Chunks are at least this large, smaller files are parsed on the calling thread
+    const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    const char* skipSpaces(const char *p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+        return p;
+    }
+
+    const char* nextLine(const char *p, const char *end) {
+        const char *newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        return newline ? newline + 1 : end;
+    }
+
+    bool endOfLine(const char *p, const char *end) {
+        return p >= end || *p == '\n' || *p == '#';
+    }
+
+    // from_chars does not take a leading '+', which some exporters write
+    template<typename T>
+    bool parseNumber(const char *&p, const char *end, T &value) {
+        p = skipSpaces(p, end);
+        if (p < end && *p == '+')
+            p++;
+        auto [next, error] = std::from_chars(p, end, value);
+        if (error != std::errc())
+            return false;
+        p = next;
+        return true;
+    }
+
+    // Splits [begin, end) into about count ranges that each start at the beginning of a line
+    std::vector<const char*> splitLines(const char *begin, const char *end, size_t count) {
+        std::vector<const char*> bounds{begin};
+        size_t step = (end - begin) / std::max<size_t>(count, 1) + 1;
+        for (size_t i = 1; i < count; i++) {
+            const char *cut = nextLine(std::max(begin + std::min(i * step, (size_t)(end - begin)), bounds.back()), end);
+            if (cut >= end)
+                break;
+            if (cut > bounds.back())
+                bounds.push_back(cut);
+        }
+        bounds.push_back(end);
+        return bounds;
+    }
+
+    size_t chunkCount(size_t bytes) {
+        return std::clamp<size_t>(bytes / MIN_CHUNK_BYTES, 1, (size_t)workerCount() * 4);
+    }
+
+    // ---------------------------------------------------------------- OBJ
+
+    // One face corner. Indices are 0-based, -1 if missing. Negative file indices count back from the
+    // end of the chunk's own list, those are flagged and only made global once the chunk offsets are known.
+    struct ObjCorner {
+        int position = -1;
+        int texCoord = -1;
+        int normal = -1;
+        unsigned char relative = 0;     // RELATIVE_* bits
+    };
+
+    const unsigned char RELATIVE_POSITION = 1, RELATIVE_TEXCOORD = 2, RELATIVE_NORMAL = 4;
+
+    struct ObjChunk {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texCoords;
+        std::vector<glm::vec3> normals;
+        std::vector<ObjCorner> corners;     // Three per triangle
+        bool hasTexCoords = false;
+        bool hasNormals = false;
+        bool failed = false;
+    };
+
+    bool parseObjIndex(const char *&p, const char *end, size_t localCount, int &index, unsigned char &relative,
+                       unsigned char flag) {
+        long long value;
+        if (!parseNumber(p, end, value) || value == 0)
+            return false;
+        if (value > 0) {
+            index = (int)(value - 1);
+        } else {
+            index = (int)((long long)localCount + value);
+            relative |= flag;
+        }
+        return true;
+    }
+
+    void parseObjChunk(const char *p, const char *end, ObjChunk &chunk) {
+        std::vector<ObjCorner> polygon;
+        while (p < end) {
+            const char *line = skipSpaces(p, end);
+            p = nextLine(line, end);
+            if (end - line < 2)
+                continue;
+
+            if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+                const char *q = line + 1;
+                glm::vec3 position;
+                if (!parseNumber(q, end, position.x) || !parseNumber(q, end, position.y) || !parseNumber(q, end, position.z)) {
+                    chunk.failed = true;
+                    return;
+                }
+                chunk.positions.push_back(position);
+            } else if (line[0] == 'v' && line[1] == 't') {
+                const char *q = line + 2;
+                glm::vec2 texCoord;
+                if (!parseNumber(q, end, texCoord.x)) {
+                    chunk.failed = true;
+                    return;
+                }
+                // The v coordinate is optional
+                if (!parseNumber(q, end, texCoord.y))
+                    texCoord.y = 0.0f;
+                chunk.texCoords.push_back(texCoord);
+            } else if (line[0] == 'v' && line[1] == 'n') {
+                const char *q = line + 2;
+                glm::vec3 normal;
+                if (!parseNumber(q, end, normal.x) || !parseNumber(q, end, normal.y) || !parseNumber(q, end, normal.z)) {
+                    chunk.failed = true;
+                    return;
+                }
+                chunk.normals.push_back(normal);
+            } else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+                // Corners are p, p/t, p//n or p/t/n
+                polygon.clear();
+                const char *q = line + 1;
+                while (!endOfLine(q = skipSpaces(q, end), end)) {
+                    ObjCorner corner;
+                    if (!parseObjIndex(q, end, chunk.positions.size(), corner.position, corner.relative, RELATIVE_POSITION)) {
+                        chunk.failed = true;
+                        return;
+                    }
+                    if (q < end && *q == '/') {
+                        q++;
+                        if (q < end && *q != '/') {
+                            if (!parseObjIndex(q, end, chunk.texCoords.size(), corner.texCoord, corner.relative, RELATIVE_TEXCOORD)) {
+                                chunk.failed = true;
+                                return;
+                            }
+                            chunk.hasTexCoords = true;
+                        }
+                        if (q < end && *q == '/') {
+                            q++;
+                            if (!parseObjIndex(q, end, chunk.normals.size(), corner.normal, corner.relative, RELATIVE_NORMAL)) {
+                                chunk.failed = true;
+                                return;
+                            }
+                            chunk.hasNormals = true;
+                        }
+                    }
+                    polygon.push_back(corner);
+                }
+                for (size_t i = 1; i + 1 < polygon.size(); i++) {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[i]);
+                    chunk.corners.push_back(polygon[i + 1]);
+                }
+            }
+            // Groups, objects, materials and smoothing groups are ignored
+        }
+    }
+
+    struct CornerHash {
+        size_t operator()(const ObjCorner &corner) const {
+            uint64_t hash = 14695981039346656037ull;
+            for (int value : {corner.position, corner.texCoord, corner.normal}) {
+                hash ^= (uint32_t)value;
+                hash *= 1099511628211ull;
+            }
+            return (size_t)hash;
+        }
+    };
+
+    struct CornerEqual {
+        bool operator()(const ObjCorner &a, const ObjCorner &b) const {
+            return a.position == b.position && a.texCoord == b.texCoord && a.normal == b.normal;
+        }
+    };
+
+    // Concatenates one array of every chunk, each chunk copies its part into place
+    template<typename T>
+    std::vector<T> gather(std::vector<ObjChunk> &chunks, std::vector<T> ObjChunk::*array, std::vector<size_t> &offsets) {
+        offsets.assign(chunks.size() + 1, 0);
+        for (size_t c = 0; c < chunks.size(); c++)
+            offsets[c + 1] = offsets[c] + (chunks[c].*array).size();
+
+        std::vector<T> all(offsets.back());
+        parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++) {
+                std::copy((chunks[c].*array).begin(), (chunks[c].*array).end(), all.begin() + offsets[c]);
+                std::vector<T>().swap(chunks[c].*array);
+            }
+        });
+        return all;
+    }
+
+    bool loadObj(const char *begin, const char *end, MeshData &data, size_t &chunkTotal) {
+        std::vector<const char*> bounds = splitLines(begin, end, chunkCount(end - begin));
+        std::vector<ObjChunk> chunks(bounds.size() - 1);
+        chunkTotal = chunks.size();
+        parallelFor(chunks.size(), 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++)
+                parseObjChunk(bounds[c], bounds[c + 1], chunks[c]);
+        });
+
+        bool hasTexCoords = false, hasNormals = false;
+        for (const ObjChunk &chunk : chunks) {
+            if (chunk.failed) {
+                std::cerr << "ERROR::MESH_LOADER::OBJ_PARSE_FAILED" << std::endl;
+                return false;
+            }
+            hasTexCoords |= chunk.hasTexCoords;
+            hasNormals |= chunk.hasNormals;
+        }
+
+        // Chunk local corners become global, relative ones are offset by everything before their chunk
+        std::vector<size_t> positionOffsets, texCoordOffsets, normalOffsets, cornerOffsets;
+        std::vector<glm::vec3> positions = gather(chunks, &ObjChunk::positions, positionOffsets);
+        std::vector<glm::vec2> texCoords = gather(chunks, &ObjChunk::texCoords, texCoordOffsets);
+        std::vector<glm::vec3> normals = gather(chunks, &ObjChunk::normals, normalOffsets);
+
+        std::atomic<bool> outOfRange(false);
+        parallelFor(chunks.size(), 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++)
+                for (ObjCorner &corner : chunks[c].corners) {
+                    if (corner.relative & RELATIVE_POSITION)
+                        corner.position += (int)positionOffsets[c];
+                    if (corner.relative & RELATIVE_TEXCOORD)
+                        corner.texCoord += (int)texCoordOffsets[c];
+                    if (corner.relative & RELATIVE_NORMAL)
+                        corner.normal += (int)normalOffsets[c];
+                    if (corner.position < 0 || (size_t)corner.position >= positions.size() ||
+                        corner.texCoord < -1 || corner.texCoord >= (int)texCoords.size() ||
+                        corner.normal < -1 || corner.normal >= (int)normals.size())
+                        outOfRange = true;
+                }
+        });
+        if (outOfRange) {
+            std::cerr << "ERROR::MESH_LOADER::OBJ_INDEX_OUT_OF_RANGE" << std::endl;
+            return false;
+        }
+        std::vector<ObjCorner> corners = gather(chunks, &ObjChunk::corners, cornerOffsets);
+
+        bool missingNormals = !hasNormals;
+        if (!hasTexCoords && !hasNormals) {
+            // Positions only, as most scans are: every position is one vertex
+            data.vertices.resize(positions.size());
+            data.indices.resize(corners.size());
+            parallelFor(positions.size(), 1 << 16, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++)
+                    data.vertices[i] = Vertex{positions[i], glm::vec3(0.0f), glm::vec2(0.0f)};
+            });
+            parallelFor(corners.size(), 1 << 16, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++)
+                    data.indices[i] = (unsigned int)corners[i].position;
+            });
+        } else {
+            // Every distinct position, uv and normal combination is one vertex
+            std::unordered_map<ObjCorner, unsigned int, CornerHash, CornerEqual> unique;
+            unique.reserve(positions.size());
+            data.vertices.reserve(positions.size());
+            data.indices.resize(corners.size());
+            for (size_t i = 0; i < corners.size(); i++) {
+                const ObjCorner &corner = corners[i];
+                missingNormals |= corner.normal < 0;
+                auto [found, inserted] = unique.emplace(corner, (unsigned int)data.vertices.size());
+                if (inserted)
+                    data.vertices.push_back(Vertex{positions[corner.position],
+                                                   corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f),
+                                                   corner.texCoord >= 0 ? texCoords[corner.texCoord] : glm::vec2(0.0f)});
+                data.indices[i] = found->second;
+            }
+        }
+
+        // Faces written without normals next to faces with them only get normals of their own
+        if (missingNormals)
+            computeNormals(data, hasNormals);
+        return true;
+    }
+
+    // ---------------------------------------------------------------- PLY
+
+    enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+    PlyType plyType(const std::string &name) {
+        if (name == "char" || name == "int8") return PlyType::Int8;
+        if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+        if (name == "short" || name == "int16") return PlyType::Int16;
+        if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+        if (name == "int" || name == "int32") return PlyType::Int32;
+        if (name == "uint" || name == "uint32") return PlyType::UInt32;
+        if (name == "float" || name == "float32") return PlyType::Float32;
+        if (name == "double" || name == "float64") return PlyType::Float64;
+        return PlyType::Invalid;
+    }
+
+    size_t plySize(PlyType type) {
+        switch (type) {
+            case PlyType::Int8: case PlyType::UInt8: return 1;
+            case PlyType::Int16: case PlyType::UInt16: return 2;
+            case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+            case PlyType::Float64: return 8;
+            default: return 0;
+        }
+    }
+
+    // Reads one little endian value, the host is assumed to be little endian as well
+    double readBinary(const char *p, PlyType type) {
+        switch (type) {
+            case PlyType::Int8: { int8_t v; std::memcpy(&v, p, 1); return v; }
+            case PlyType::UInt8: { uint8_t v; std::memcpy(&v, p, 1); return v; }
+            case PlyType::Int16: { int16_t v; std::memcpy(&v, p, 2); return v; }
+            case PlyType::UInt16: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+            case PlyType::Int32: { int32_t v; std::memcpy(&v, p, 4); return v; }
+            case PlyType::UInt32: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+            case PlyType::Float32: { float v; std::memcpy(&v, p, 4); return v; }
+            case PlyType::Float64: { double v; std::memcpy(&v, p, 8); return v; }
+            default: return 0.0;
+        }
+    }
+
+    struct PlyProperty {
+        std::string name;
+        PlyType type = PlyType::Invalid;
+        bool list = false;
+        PlyType countType = PlyType::Invalid;
+        int slot = -1;      // Vertex attribute it fills, see VERTEX_SLOTS
+    };
+
+    struct PlyElement {
+        std::string name;
+        size_t count = 0;
+        std::vector<PlyProperty> properties;
+        int indexProperty = -1;     // Face list holding the corner indices
+    };
+
+    // Vertex properties the loader understands, in Vertex order: position, normal, uv
+    const char* const VERTEX_SLOTS[][3] = {
+        {"x", nullptr, nullptr}, {"y", nullptr, nullptr}, {"z", nullptr, nullptr},
+        {"nx", nullptr, nullptr}, {"ny", nullptr, nullptr}, {"nz", nullptr, nullptr},
+        {"u", "s", "texture_u"}, {"v", "t", "texture_v"}
+    };
+
+    Vertex vertexFromSlots(const float (&slots)[8]) {
+        return Vertex{glm::vec3(slots[0], slots[1], slots[2]), glm::vec3(slots[3], slots[4], slots[5]),
+                      glm::vec2(slots[6], slots[7])};
+    }
+
+    bool parsePlyHeader(const char *&p, const char *end, bool &binary, std::vector<PlyElement> &elements) {
+        auto readLine = [&]() {
+            const char *line = p;
+            p = nextLine(p, end);
+            const char *lineEnd = p;
+            while (lineEnd > line && (lineEnd[-1] == '\n' || lineEnd[-1] == '\r'))
+                lineEnd--;
+            return std::string(line, lineEnd);
+        };
+
+        if (readLine() != "ply")
+            return false;
+        while (p < end) {
+            std::string line = readLine();
+            std::vector<std::string> words;
+            for (size_t start = 0; start < line.size();) {
+                size_t stop = line.find_first_of(" \t", start);
+                if (stop == std::string::npos)
+                    stop = line.size();
+                if (stop > start)
+                    words.push_back(line.substr(start, stop - start));
+                start = stop + 1;
+            }
+            if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+                continue;
+
+            if (words[0] == "end_header") {
+                return true;
+            } else if (words[0] == "format" && words.size() >= 2) {
+                if (words[1] == "ascii") {
+                    binary = false;
+                } else if (words[1] == "binary_little_endian") {
+                    binary = true;
+                } else {
+                    std::cerr << "ERROR::MESH_LOADER::PLY_UNSUPPORTED_FORMAT: " << words[1] << std::endl;
+                    return false;
+                }
+            } else if (words[0] == "element" && words.size() >= 3) {
+                PlyElement element;
+                element.name = words[1];
+                const char *first = words[2].data(), *last = first + words[2].size();
+                auto [next, error] = std::from_chars(first, last, element.count);
+                if (error != std::errc() || next != last) {
+                    std::cerr << "ERROR::MESH_LOADER::PLY_BAD_ELEMENT_COUNT: " << line << std::endl;
+                    return false;
+                }
+                elements.push_back(element);
+            } else if (words[0] == "property" && words.size() >= 3 && !elements.empty()) {
+                PlyProperty property;
+                if (words[1] == "list" && words.size() >= 5) {
+                    property.list = true;
+                    property.countType = plyType(words[2]);
+                    property.type = plyType(words[3]);
+                    property.name = words[4];
+                } else {
+                    property.type = plyType(words[1]);
+                    property.name = words[2];
+                }
+                if (property.type == PlyType::Invalid || (property.list && property.countType == PlyType::Invalid)) {
+                    std::cerr << "ERROR::MESH_LOADER::PLY_UNKNOWN_TYPE: " << line << std::endl;
+                    return false;
+                }
+
+                PlyElement &element = elements.back();
+                if (element.name == "vertex" && !property.list)
+                    for (int slot = 0; slot < 8; slot++)
+                        for (const char *name : VERTEX_SLOTS[slot])
+                            if (name && property.name == name)
+                                property.slot = slot;
+                if (element.name == "face" && property.list &&
+                    (property.name == "vertex_indices" || property.name == "vertex_index"))
+                    element.indexProperty = (int)element.properties.size();
+                element.properties.push_back(property);
+            }
+        }
+        return false;
+    }
+
+    // Triangulates one face of corner indices into out, false if an index is out of range
+    bool addFace(const unsigned int *corners, size_t count, size_t vertexCount, std::vector<unsigned int> &out) {
+        for (size_t i = 0; i < count; i++)
+            if (corners[i] >= vertexCount)
+                return false;
+        for (size_t i = 1; i + 1 < count; i++) {
+            out.push_back(corners[0]);
+            out.push_back(corners[i]);
+            out.push_back(corners[i + 1]);
+        }
+        return true;
+    }
+
+    bool loadPlyAscii(const char *begin, const char *end, const std::vector<PlyElement> &elements,
+                      const PlyElement *vertexElement, MeshData &data, size_t &chunkTotal) {
+        // Lines per chunk first, so every chunk knows the element and row of its first line
+        std::vector<const char*> bounds = splitLines(begin, end, chunkCount(end - begin));
+        size_t chunks = bounds.size() - 1;
+        chunkTotal = chunks;
+        std::vector<size_t> firstLine(chunks + 1, 0);
+        parallelFor(chunks, 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++)
+                firstLine[c + 1] = std::count(bounds[c], bounds[c + 1], '\n');
+        });
+        for (size_t c = 0; c < chunks; c++)
+            firstLine[c + 1] += firstLine[c];
+
+        std::vector<size_t> elementStart(elements.size() + 1, 0);
+        for (size_t e = 0; e < elements.size(); e++)
+            elementStart[e + 1] = elementStart[e] + elements[e].count;
+
+        data.vertices.resize(vertexElement->count);
+        std::vector<std::vector<unsigned int>> faces(chunks);
+        std::atomic<bool> failed(false);
+        parallelFor(chunks, 1, [&](size_t first, size_t last) {
+            std::vector<unsigned int> corners;
+            for (size_t c = first; c < last && !failed; c++) {
+                size_t line = firstLine[c];
+                size_t element = std::upper_bound(elementStart.begin(), elementStart.end(), line) - elementStart.begin() - 1;
+                for (const char *p = bounds[c]; p < bounds[c + 1] && element < elements.size(); line++) {
+                    while (element < elements.size() && line >= elementStart[element + 1])
+                        element++;
+                    const char *q = p;
+                    p = nextLine(p, bounds[c + 1]);
+                    if (element >= elements.size())
+                        break;
+
+                    const PlyElement &current = elements[element];
+                    bool isVertex = &current == vertexElement;
+                    float slots[8] = {};
+                    corners.clear();
+                    for (size_t i = 0; i < current.properties.size(); i++) {
+                        const PlyProperty &property = current.properties[i];
+                        size_t count = 1;
+                        if (property.list) {
+                            if (!parseNumber(q, p, count)) {
+                                failed = true;
+                                break;
+                            }
+                        }
+                        for (size_t k = 0; k < count; k++) {
+                            double value;
+                            if (!parseNumber(q, p, value)) {
+                                failed = true;
+                                break;
+                            }
+                            if (isVertex && property.slot >= 0)
+                                slots[property.slot] = (float)value;
+                            else if ((int)i == current.indexProperty)
+                                corners.push_back((unsigned int)value);
+                        }
+                    }
+                    if (failed)
+                        break;
+                    if (isVertex)
+                        data.vertices[line - elementStart[element]] = vertexFromSlots(slots);
+                    else if (current.indexProperty >= 0 && !addFace(corners.data(), corners.size(), vertexElement->count, faces[c]))
+                        failed = true;
+                }
+            }
+        });
+        if (failed) {
+            std::cerr << "ERROR::MESH_LOADER::PLY_PARSE_FAILED" << std::endl;
+            return false;
+        }
+
+        std::vector<size_t> offsets(chunks + 1, 0);
+        for (size_t c = 0; c < chunks; c++)
+            offsets[c + 1] = offsets[c] + faces[c].size();
+        data.indices.resize(offsets.back());
+        parallelFor(chunks, 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++)
+                std::copy(faces[c].begin(), faces[c].end(), data.indices.begin() + offsets[c]);
+        });
+        return true;
+    }
+
+    bool loadPlyBinary(const char *begin, const char *end, const std::vector<PlyElement> &elements,
+                       const PlyElement *vertexElement, MeshData &data, size_t &chunkTotal) {
+        const char *p = begin;
+        chunkTotal = 0;
+        for (const PlyElement &element : elements) {
+            bool scalar = std::none_of(element.properties.begin(), element.properties.end(),
+                                       [](const PlyProperty &property) { return property.list; });
+            size_t stride = 0;
+            for (const PlyProperty &property : element.properties)
+                stride += plySize(property.type);
+
+            if (scalar) {
+                if ((size_t)(end - p) < stride * element.count) {
+                    std::cerr << "ERROR::MESH_LOADER::PLY_TRUNCATED" << std::endl;
+                    return false;
+                }
+                if (&element == vertexElement) {
+                    // Fixed size rows, every one is decoded straight into its vertex
+                    data.vertices.resize(element.count);
+                    chunkTotal += (element.count * stride) / MIN_CHUNK_BYTES + 1;
+                    parallelFor(element.count, MIN_CHUNK_BYTES / std::max<size_t>(stride, 1), [&](size_t first, size_t last) {
+                        for (size_t row = first; row < last; row++) {
+                            const char *q = p + row * stride;
+                            float slots[8] = {};
+                            for (const PlyProperty &property : element.properties) {
+                                if (property.slot >= 0)
+                                    slots[property.slot] = (float)readBinary(q, property.type);
+                                q += plySize(property.type);
+                            }
+                            data.vertices[row] = vertexFromSlots(slots);
+                        }
+                    });
+                }
+                p += stride * element.count;
+                continue;
+            }
+
+            // Rows vary in size, a quick walk over the list counts finds where each chunk of rows starts
+            // and how many triangles it holds, then the chunks are decoded in parallel
+            const size_t rowsPerChunk = std::max<size_t>(element.count / chunkCount(end - p), 1);
+            std::vector<const char*> chunkStart;
+            std::vector<size_t> chunkIndices{0};
+            for (size_t row = 0; row < element.count; row++) {
+                if (row % rowsPerChunk == 0) {
+                    chunkStart.push_back(p);
+                    if (row)
+                        chunkIndices.push_back(0);
+                }
+                for (size_t i = 0; i < element.properties.size(); i++) {
+                    const PlyProperty &property = element.properties[i];
+                    size_t count = 1;
+                    if (property.list) {
+                        if (p + plySize(property.countType) > end) {
+                            std::cerr << "ERROR::MESH_LOADER::PLY_TRUNCATED" << std::endl;
+                            return false;
+                        }
+                        count = (size_t)readBinary(p, property.countType);
+                        p += plySize(property.countType);
+                        if ((int)i == element.indexProperty && count > 2)
+                            chunkIndices.back() += (count - 2) * 3;
+                    }
+                    p += count * plySize(property.type);
+                }
+                if (p > end) {
+                    std::cerr << "ERROR::MESH_LOADER::PLY_TRUNCATED" << std::endl;
+                    return false;
+                }
+            }
+            if (element.indexProperty < 0)
+                continue;
+
+            size_t chunks = chunkStart.size();
+            chunkTotal += chunks;
+            std::vector<size_t> offsets(chunks + 1, 0);
+            for (size_t c = 0; c < chunks; c++)
+                offsets[c + 1] = offsets[c] + chunkIndices[c];
+            data.indices.resize(offsets.back());
+
+            std::atomic<bool> outOfRange(false);
+            parallelFor(chunks, 1, [&](size_t first, size_t last) {
+                std::vector<unsigned int> corners, triangles;
+                for (size_t c = first; c < last; c++) {
+                    const char *q = chunkStart[c];
+                    size_t rows = std::min(rowsPerChunk, element.count - c * rowsPerChunk);
+                    triangles.clear();
+                    for (size_t row = 0; row < rows; row++)
+                        for (size_t i = 0; i < element.properties.size(); i++) {
+                            const PlyProperty &property = element.properties[i];
+                            size_t count = 1;
+                            if (property.list) {
+                                count = (size_t)readBinary(q, property.countType);
+                                q += plySize(property.countType);
+                            }
+                            if ((int)i == element.indexProperty) {
+                                corners.resize(count);
+                                for (size_t k = 0; k < count; k++)
+                                    corners[k] = (unsigned int)readBinary(q + k * plySize(property.type), property.type);
+                                if (!addFace(corners.data(), count, vertexElement->count, triangles))
+                                    outOfRange = true;
+                            }
+                            q += count * plySize(property.type);
+                        }
+                    std::copy(triangles.begin(), triangles.end(), data.indices.begin() + offsets[c]);
+                }
+            });
+            if (outOfRange) {
+                std::cerr << "ERROR::MESH_LOADER::PLY_INDEX_OUT_OF_RANGE" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool loadPly(const char *begin, const char *end, MeshData &data, size_t &chunkTotal) {
+        const char *p = begin;
+        bool binary = false;
+        std::vector<PlyElement> elements;
+        if (!parsePlyHeader(p, end, binary, elements)) {
+            std::cerr << "ERROR::MESH_LOADER::PLY_INVALID_HEADER" << std::endl;
+            return false;
+        }
+
+        const PlyElement *vertexElement = nullptr;
+        bool hasNormals = false;
+        for (const PlyElement &element : elements)
+            if (element.name == "vertex") {
+                vertexElement = &element;
+                for (const PlyProperty &property : element.properties)
+                    hasNormals |= property.slot == 3;
+            }
+        if (!vertexElement) {
+            std::cerr << "ERROR::MESH_LOADER::PLY_NO_VERTICES" << std::endl;
+            return false;
+        }
+
+        bool loaded = binary ? loadPlyBinary(p, end, elements, vertexElement, data, chunkTotal)
+                             : loadPlyAscii(p, end, elements, vertexElement, data, chunkTotal);
+        if (loaded && !hasNormals)
+            computeNormals(data);
+        return loaded;
+    }
+}
+
+double LoadStats::megabytesPerSecond() const {
+    return milliseconds > 0.0 ? bytes / (1024.0 * 1024.0) / (milliseconds / 1000.0) : 0.0;
+}
+
+double LoadStats::trianglesPerSecond() const {
+    return milliseconds > 0.0 ? triangles / (milliseconds / 1000.0) : 0.0;
+}
+
+bool loadMesh(const std::string &path, MeshData &data, LoadStats *stats) {
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file(path);
+    if (!file.data) {
+        std::cerr << "ERROR::MESH_LOADER::FILE_NOT_READ: " << path << std::endl;
+        return false;
+    }
+
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+
+    MeshData loaded;
+    size_t chunks = 0;
+    bool success;
+    if (extension == "obj") {
+        success = loadObj(file.data, file.data + file.size, loaded, chunks);
+    } else if (extension == "ply") {
+        success = loadPly(file.data, file.data + file.size, loaded, chunks);
+    } else {
+        std::cerr << "ERROR::MESH_LOADER::UNKNOWN_EXTENSION: " << path << std::endl;
+        return false;
+    }
+    if (!success)
+        return false;
+
+    // Files without uvs keep zero tangents and are drawn with derivative frames
+    computeTangents(loaded);
+    data = std::move(loaded);
+    if (stats) {
+        stats->bytes = file.size;
+        stats->vertices = data.vertices.size();
+        stats->triangles = data.indices.size() / 3;
+        stats->chunks = chunks;
+        stats->archived = false;
+        meshBounds(data, stats->boundsMin, stats->boundsMax);
+        stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
+
+void meshBounds(const MeshData &data, glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+    boundsMin = boundsMax = data.vertices.empty() ? glm::vec3(0.0f) : data.vertices[0].position;
+    for (const Vertex &vertex : data.vertices) {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+}
+
+void computeNormals(MeshData &data, bool missingOnly) {
+    // Vertices that get a computed normal, all of them unless only the missing ones are filled in
+    std::vector<unsigned char> computed(data.vertices.size(), 1);
+    for (size_t i = 0; i < data.vertices.size(); i++) {
+        Vertex &vertex = data.vertices[i];
+        if (missingOnly)
+            computed[i] = vertex.normal == glm::vec3(0.0f);
+        if (computed[i])
+            vertex.normal = glm::vec3(0.0f);
+    }
+    for (size_t i = 0; i + 2 < data.indices.size(); i += 3) {
+        const unsigned int corners[3] = {data.indices[i], data.indices[i + 1], data.indices[i + 2]};
+        const glm::vec3 &a = data.vertices[corners[0]].position;
+        glm::vec3 normal = glm::cross(data.vertices[corners[1]].position - a, data.vertices[corners[2]].position - a);
+        for (unsigned int corner : corners)
+            if (computed[corner])
+                data.vertices[corner].normal += normal;
+    }
+    parallelFor(data.vertices.size(), 1 << 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (!computed[i])
+                continue;
+            glm::vec3 &normal = data.vertices[i].normal;
+            float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    });
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "Mesh.h"
+
+// Size and speed of one load, throughput covers the whole load including the file mapping
+struct LoadStats {
+    size_t bytes = 0;
+    size_t vertices = 0;
+    size_t triangles = 0;
+    size_t chunks = 0;
+    double milliseconds = 0.0;
+    bool archived = false;      // Read from a mesh archive instead of being parsed
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    double megabytesPerSecond() const;
+    double trianglesPerSecond() const;
+};
+
+/*
+ * Loads Wavefront OBJ and PLY (ASCII or binary little endian) files into
+ * MeshData. The file is memory-mapped and split into chunks at line or row
+ * boundaries, the chunks are parsed in parallel into their own buffers which
+ * are then copied once into the final arrays at offsets known from the chunk
+ * sizes. Polygons are triangulated as fans and missing normals are computed
+ * from the faces. Meshes with uvs get tangents, see computeTangents().
+ *
+ * */
+
+bool loadMesh(const std::string &path, MeshData &data, LoadStats *stats = nullptr);
+
+// Axis aligned bounds of the vertex positions, zero for an empty mesh
+void meshBounds(const MeshData &data, glm::vec3 &boundsMin, glm::vec3 &boundsMax);
+
+// Area weighted vertex normals of an indexed triangle list, used when a file has none.
+// With missingOnly only zero normals are replaced, the ones a file left out for some faces.
+void computeNormals(MeshData &data, bool missingOnly = false);
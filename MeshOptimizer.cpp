@@ -0,0 +1,263 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+
+namespace {
+    // Scoring constants from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+    const int CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    float vertexScore(int cachePosition, unsigned int remainingTriangles) {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            // The three vertices of the last triangle get a fixed score so it is not reused right away
+            if (cachePosition < 3)
+                score = LAST_TRIANGLE_SCORE;
+            else
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        // Vertices with few triangles left are finished first so they do not linger
+        score += VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+        return score;
+    }
+
+    // Bitwise hash and equality so only exact duplicates are welded
+    struct VertexHash {
+        size_t operator()(const Vertex &vertex) const {
+            const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&vertex);
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(Vertex); i++) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+            return (size_t)hash;
+        }
+    };
+
+    struct VertexEqual {
+        bool operator()(const Vertex &a, const Vertex &b) const {
+            return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+}
+
+MeshStats analyzeMesh(const MeshData &data, int cacheSize) {
+    MeshStats stats;
+    if (data.primitive != GL_TRIANGLES)
+        return stats;
+
+    stats.triangles = data.indices.size() / 3;
+
+    // A vertex is still cached if fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loadedAt(data.vertices.size(), 0);
+    std::vector<bool> referenced(data.vertices.size(), false);
+    size_t misses = 0;
+    for (unsigned int index : data.indices) {
+        if (!referenced[index] || misses - loadedAt[index] >= (size_t)cacheSize) {
+            loadedAt[index] = misses++;
+            if (!referenced[index]) {
+                referenced[index] = true;
+                stats.vertices++;
+            }
+        }
+    }
+
+    stats.acmr = stats.triangles ? (float)misses / stats.triangles : 0.0f;
+    stats.atvr = stats.vertices ? (float)misses / stats.vertices : 0.0f;
+    return stats;
+}
+
+size_t weldVertices(MeshData &data) {
+    if (data.primitive != GL_TRIANGLES)
+        return 0;
+
+    std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+    unique.reserve(data.vertices.size());
+    std::vector<unsigned int> remap(data.vertices.size());
+    std::vector<Vertex> vertices;
+    vertices.reserve(data.vertices.size());
+
+    for (size_t i = 0; i < data.vertices.size(); i++) {
+        auto [found, inserted] = unique.emplace(data.vertices[i], (unsigned int)vertices.size());
+        if (inserted)
+            vertices.push_back(data.vertices[i]);
+        remap[i] = found->second;
+    }
+
+    for (unsigned int &index : data.indices)
+        index = remap[index];
+
+    size_t welded = data.vertices.size() - vertices.size();
+    data.vertices = std::move(vertices);
+    return welded;
+}
+
+size_t removeDegenerateTriangles(MeshData &data) {
+    if (data.primitive != GL_TRIANGLES)
+        return 0;
+
+    size_t kept = 0;
+    for (size_t i = 0; i + 2 < data.indices.size(); i += 3) {
+        unsigned int a = data.indices[i], b = data.indices[i + 1], c = data.indices[i + 2];
+        if (a == b || b == c || c == a)
+            continue;
+
+        glm::vec3 ab = data.vertices[b].position - data.vertices[a].position;
+        glm::vec3 ac = data.vertices[c].position - data.vertices[a].position;
+        glm::vec3 bc = data.vertices[c].position - data.vertices[b].position;
+        float longestEdge = std::max(glm::dot(ab, ab), std::max(glm::dot(ac, ac), glm::dot(bc, bc)));
+
+        // Twice the area against the longest edge squared, which keeps the test scale independent
+        glm::vec3 normal = glm::cross(ab, ac);
+        if (std::sqrt(glm::dot(normal, normal)) <= 1e-6f * longestEdge)
+            continue;
+
+        data.indices[kept++] = a;
+        data.indices[kept++] = b;
+        data.indices[kept++] = c;
+    }
+
+    size_t removed = (data.indices.size() - kept) / 3;
+    data.indices.resize(kept);
+    return removed;
+}
+
+void optimizeVertexCache(MeshData &data) {
+    if (data.primitive != GL_TRIANGLES || data.indices.empty())
+        return;
+
+    const size_t vertexCount = data.vertices.size();
+    const size_t triangleCount = data.indices.size() / 3;
+    const std::vector<unsigned int> &indices = data.indices;
+
+    // Triangles adjacent to each vertex, in one array with per vertex offsets
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> filled(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[filled[indices[t * 3 + k]]++] = (unsigned int)t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    size_t best = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+    size_t scanCursor = 0;
+
+    while (result.size() < indices.size()) {
+        emitted[best] = true;
+        unsigned int triangle[3] = {indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2]};
+
+        nextCache.assign(triangle, triangle + 3);
+        for (unsigned int vertex : triangle) {
+            result.push_back(vertex);
+
+            // Drop the triangle from the vertex's adjacency list
+            unsigned int *begin = &adjacency[offsets[vertex]];
+            unsigned int *end = begin + remaining[vertex];
+            *std::find(begin, end, (unsigned int)best) = *(end - 1);
+            remaining[vertex]--;
+        }
+        for (unsigned int vertex : cache)
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                nextCache.push_back(vertex);
+
+        // Vertices pushed out of the cache lose their position score
+        for (size_t i = CACHE_SIZE; i < nextCache.size(); i++) {
+            cachePosition[nextCache[i]] = -1;
+            vertexScores[nextCache[i]] = vertexScore(-1, remaining[nextCache[i]]);
+        }
+        nextCache.resize(std::min<size_t>(nextCache.size(), CACHE_SIZE));
+        std::swap(cache, nextCache);
+
+        for (size_t i = 0; i < cache.size(); i++) {
+            cachePosition[cache[i]] = (int)i;
+            vertexScores[cache[i]] = vertexScore((int)i, remaining[cache[i]]);
+        }
+
+        // Only triangles touching the cache changed, the best of them is emitted next
+        float bestScore = -1.0f;
+        for (unsigned int vertex : cache)
+            for (unsigned int i = 0; i < remaining[vertex]; i++) {
+                unsigned int t = adjacency[offsets[vertex] + i];
+                float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                triangleScores[t] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+
+        // Nothing left around the cache, continue with the next triangle not emitted yet
+        if (bestScore < 0.0f) {
+            while (scanCursor < triangleCount && emitted[scanCursor])
+                scanCursor++;
+            if (scanCursor == triangleCount)
+                break;
+            best = scanCursor;
+        }
+    }
+
+    data.indices = std::move(result);
+}
+
+void optimizeVertexFetch(MeshData &data) {
+    if (data.primitive != GL_TRIANGLES)
+        return;
+
+    const unsigned int UNUSED = 0xFFFFFFFF;
+    std::vector<unsigned int> remap(data.vertices.size(), UNUSED);
+    std::vector<Vertex> vertices;
+    vertices.reserve(data.vertices.size());
+
+    for (unsigned int &index : data.indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = (unsigned int)vertices.size();
+            vertices.push_back(data.vertices[index]);
+        }
+        index = remap[index];
+    }
+    data.vertices = std::move(vertices);
+}
+
+OptimizeReport optimizeMesh(MeshData &data) {
+    OptimizeReport report;
+    report.before = analyzeMesh(data);
+    report.welded = weldVertices(data);
+    report.degenerate = removeDegenerateTriangles(data);
+    optimizeVertexCache(data);
+    optimizeVertexFetch(data);
+    report.after = analyzeMesh(data);
+    return report;
+}
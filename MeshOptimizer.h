@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include "Mesh.h"
+
+// Post-transform vertex cache statistics of an indexed triangle list
+struct MeshStats {
+    size_t vertices = 0;
+    size_t triangles = 0;
+    float acmr = 0.0f;      // Cache misses per triangle, 0.5 is the limit for large regular meshes
+    float atvr = 0.0f;      // Cache misses per referenced vertex, 1.0 is optimal
+};
+
+struct OptimizeReport {
+    MeshStats before;
+    MeshStats after;
+    size_t welded = 0;          // Vertices merged into an identical one
+    size_t degenerate = 0;      // Zero-area triangles removed
+};
+
+/*
+ * Optimization passes over MeshData, run before the data is uploaded into a
+ * Mesh. Only triangle lists are changed, strips are returned untouched.
+ *
+ * */
+
+// Simulates a FIFO post-transform cache of cacheSize entries
+MeshStats analyzeMesh(const MeshData &data, int cacheSize = 16);
+
+// Merges vertices whose position, normal and uv are bitwise identical
+size_t weldVertices(MeshData &data);
+// Removes triangles with repeated indices or an area that vanishes next to their longest edge
+size_t removeDegenerateTriangles(MeshData &data);
+// Reorders triangles for post-transform cache hits (Forsyth's linear-speed algorithm)
+void optimizeVertexCache(MeshData &data);
+// Renumbers vertices in the order they are first used and drops unused ones
+void optimizeVertexFetch(MeshData &data);
+
+// Runs every pass above in order
+OptimizeReport optimizeMesh(MeshData &data);
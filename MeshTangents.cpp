@@ -0,0 +1,106 @@
+#include "MeshTangents.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    // Any unit vector perpendicular to normal, for vertices whose triangles have no usable uvs
+    glm::vec3 perpendicular(glm::vec3 normal) {
+        glm::vec3 axis = std::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 tangent = glm::cross(normal, axis);
+        float length = glm::length(tangent);
+        return length > 0.0f ? tangent / length : axis;
+    }
+
+    glm::vec3 normalizeOr(glm::vec3 vector, glm::vec3 fallback) {
+        float length = glm::length(vector);
+        return length > 1e-20f ? vector / length : fallback;
+    }
+}
+
+bool computeTangents(MeshData &data) {
+    if (data.primitive != GL_TRIANGLES || data.indices.size() < 3 || data.vertices.empty())
+        return false;
+    const std::vector<Vertex> &vertices = data.vertices;
+    bool varied = std::any_of(vertices.begin(), vertices.end(), [&](const Vertex &vertex) {
+        return vertex.texCoords != vertices[0].texCoords;
+    });
+    if (!varied)
+        return false;
+
+    // One sum per vertex and orientation of the uv mapping, mirrored triangles go into the second
+    const size_t vertexCount = vertices.size(), triangleCount = data.indices.size() / 3;
+    std::vector<glm::vec3> sums(vertexCount * 2, glm::vec3(0.0f));
+    std::vector<unsigned char> orientations(vertexCount, 0);    // Bit 0 regular, bit 1 mirrored
+    std::vector<unsigned char> mirrored(triangleCount, 0);
+
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        const unsigned int *corners = &data.indices[triangle * 3];
+        if (corners[0] >= vertexCount || corners[1] >= vertexCount || corners[2] >= vertexCount)
+            continue;
+        const Vertex &v0 = vertices[corners[0]], &v1 = vertices[corners[1]], &v2 = vertices[corners[2]];
+
+        glm::vec3 edge1 = v1.position - v0.position, edge2 = v2.position - v0.position;
+        glm::vec2 uv1 = v1.texCoords - v0.texCoords, uv2 = v2.texCoords - v0.texCoords;
+        float uvArea = uv1.x * uv2.y - uv2.x * uv1.y;
+        glm::vec3 faceNormal = glm::cross(edge1, edge2);
+        if (uvArea == 0.0f || glm::length(faceNormal) == 0.0f)
+            continue;
+
+        // Direction of increasing u, the sign of the uv area keeps it pointing along +u when mirrored
+        glm::vec3 faceTangent = (edge1 * uv2.y - edge2 * uv1.y) * (uvArea > 0.0f ? 1.0f : -1.0f);
+        unsigned char side = uvArea < 0.0f;
+        mirrored[triangle] = side;
+        faceNormal = glm::normalize(faceNormal);
+
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int index = corners[corner];
+            const glm::vec3 &position = vertices[index].position;
+            glm::vec3 normal = normalizeOr(vertices[index].normal, faceNormal);
+            glm::vec3 projected = faceTangent - normal * glm::dot(normal, faceTangent);
+            float length = glm::length(projected);
+            if (length <= 1e-20f)
+                continue;
+
+            glm::vec3 toNext = normalizeOr(vertices[corners[(corner + 1) % 3]].position - position, glm::vec3(0.0f));
+            glm::vec3 toPrevious = normalizeOr(vertices[corners[(corner + 2) % 3]].position - position, glm::vec3(0.0f));
+            float angle = std::acos(glm::clamp(glm::dot(toNext, toPrevious), -1.0f, 1.0f));
+
+            sums[index * 2 + side] += projected / length * angle;
+            orientations[index] |= 1 << side;
+        }
+    }
+
+    // Vertices shared by regular and mirrored triangles are split, the copy serves the mirrored ones
+    std::vector<unsigned int> mirrorCopy(vertexCount, std::numeric_limits<unsigned int>::max());
+    for (size_t index = 0; index < vertexCount; index++) {
+        if (orientations[index] != 3)
+            continue;
+        mirrorCopy[index] = (unsigned int)data.vertices.size();
+        data.vertices.push_back(data.vertices[index]);
+    }
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        if (!mirrored[triangle])
+            continue;
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int &index = data.indices[triangle * 3 + corner];
+            if (index < vertexCount && mirrorCopy[index] != std::numeric_limits<unsigned int>::max())
+                index = mirrorCopy[index];
+        }
+    }
+
+    auto finish = [&](Vertex &vertex, glm::vec3 sum, float handedness) {
+        glm::vec3 normal = normalizeOr(vertex.normal, glm::vec3(0.0f, 1.0f, 0.0f));
+        vertex.tangent = glm::vec4(normalizeOr(sum, perpendicular(normal)), handedness);
+    };
+    for (size_t index = 0; index < vertexCount; index++) {
+        bool regular = orientations[index] & 1;
+        finish(data.vertices[index], sums[index * 2 + !regular], regular || !orientations[index] ? 1.0f : -1.0f);
+        if (mirrorCopy[index] != std::numeric_limits<unsigned int>::max())
+            finish(data.vertices[mirrorCopy[index]], sums[index * 2 + 1], -1.0f);
+    }
+
+    data.tangents = true;
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Mesh.h"
+
+/*
+ * Per-vertex tangent frames following the MikkTSpace conventions, so normal
+ * maps baked against MikkTSpace (Blender, Substance, glTF exporters) decode
+ * without seams:
+ *
+ *  - each triangle's tangent comes from its uv gradient, projected into the
+ *    plane of each corner's normal and weighted by the corner angle
+ *  - triangles whose uvs are mirrored do not share tangents with the others,
+ *    vertices used by both get split so each side keeps its own frame
+ *  - the bitangent is never stored, shaders rebuild it as
+ *    w * cross(normal, tangent) from the interpolated, unnormalized vectors
+ *
+ * Degenerate triangles contribute nothing. Vertices without any usable
+ * triangle get an arbitrary tangent perpendicular to their normal.
+ *
+ * */
+
+// Fills Vertex::tangent and sets MeshData::tangents. Needs a triangle list whose uvs are not
+// all equal, returns false and leaves data alone otherwise.
+bool computeTangents(MeshData &data);
@@ -0,0 +1,127 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Ranges of one parallelFor call, claimed by the calling thread and the workers
+    struct Batch {
+        const std::function<void(size_t begin, size_t end)> *body;
+        size_t count;
+        size_t rangeSize;
+        size_t ranges;
+        size_t next = 0;        // First range nobody claimed yet
+        size_t finished = 0;
+    };
+
+    /*
+     * Threads started on the first parallelFor and kept until exit, so a call
+     * costs a wake-up instead of creating and joining threads. Calls from
+     * several threads, or from inside a body, queue their batches. A caller
+     * works on its own batch until every range is claimed, so it never waits
+     * on a batch nobody works on.
+     *
+     * */
+    class WorkerPool {
+    public:
+        WorkerPool() {
+            for (unsigned int i = 1; i < workerCount(); i++)
+                workers.emplace_back([this]() { work(); });
+        }
+
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread &worker : workers)
+                worker.join();
+        }
+
+        void run(Batch &batch) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(&batch);
+            }
+            wake.notify_all();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            size_t range;
+            while (claim(batch, range)) {
+                lock.unlock();
+                execute(batch, range);
+                lock.lock();
+            }
+            done.wait(lock, [&]() { return batch.finished == batch.ranges; });
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        std::deque<Batch*> queue;       // Batches with unclaimed ranges, oldest first
+        bool stopping = false;
+
+        // Called with the mutex held. The batch stays alive until its claimed ranges are finished.
+        bool claim(Batch &batch, size_t &range) {
+            if (batch.next == batch.ranges)
+                return false;
+            range = batch.next++;
+            if (batch.next == batch.ranges)
+                queue.erase(std::find(queue.begin(), queue.end(), &batch));
+            return true;
+        }
+
+        void execute(Batch &batch, size_t range) {
+            size_t begin = range * batch.rangeSize;
+            (*batch.body)(begin, std::min(begin + batch.rangeSize, batch.count));
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++batch.finished == batch.ranges)
+                done.notify_all();
+        }
+
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+                if (stopping)
+                    return;
+                Batch &batch = *queue.front();
+                size_t range;
+                if (!claim(batch, range))
+                    continue;
+                lock.unlock();
+                execute(batch, range);
+                lock.lock();
+            }
+        }
+    };
+}
+
+unsigned int workerCount() {
+    static const unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+    return count;
+}
+
+void parallelFor(size_t count, size_t minRange, const std::function<void(size_t begin, size_t end)> &body) {
+    if (count == 0)
+        return;
+
+    size_t ranges = std::min<size_t>(workerCount(), (count + minRange - 1) / std::max<size_t>(minRange, 1));
+    if (ranges <= 1) {
+        body(0, count);
+        return;
+    }
+
+    static WorkerPool pool;
+    size_t rangeSize = (count + ranges - 1) / ranges;
+    Batch batch{&body, count, rangeSize, (count + rangeSize - 1) / rangeSize};
+    pool.run(batch);
+}
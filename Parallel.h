@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/*
+ * Splits [0, count) into contiguous ranges and runs them on a pool of worker
+ * threads that is started once and reused, the calling thread works on the
+ * ranges as well. Returns once every range is done. Ranges are never smaller
+ * than minRange, so small inputs stay on the calling thread.
+ *
+ * */
+
+void parallelFor(size_t count, size_t minRange, const std::function<void(size_t begin, size_t end)> &body);
+
+// Threads parallelFor uses at most, one per hardware thread
+unsigned int workerCount();
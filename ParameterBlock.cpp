@@ -0,0 +1,109 @@
+#include "ParameterBlock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <glad/glad.h>
+
+namespace {
+    // Shortest text that reads back to the same float, always with a decimal point.
+    // GLSL has no literal for infinity or NaN, those are rebuilt from their bits.
+    std::string floatLiteral(float value) {
+        char buffer[32];
+        if (!std::isfinite(value)) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            std::snprintf(buffer, sizeof(buffer), "uintBitsToFloat(0x%08Xu)", (unsigned int)bits);
+            return buffer;
+        }
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        std::string literal = buffer;
+        if (literal.find_first_of(".e") == std::string::npos)
+            literal += ".0";
+        return literal;
+    }
+
+    std::string vectorLiteral(const char *type, const float *values, int count) {
+        std::string literal = std::string(type) + "(";
+        for (int i = 0; i < count; i++)
+            literal += (i ? ", " : "") + floatLiteral(values[i]);
+        return literal + ")";
+    }
+}
+
+int ParameterBlock::uploads = 0;
+
+ParameterBlock::ParameterBlock(unsigned int binding) : binding(binding) {
+}
+
+bool ParameterBlock::reflect(const Shader &shader, const std::string &blockName) {
+    const BlockLayout *reflectedLayout = shader.block(blockName);
+    if (!reflectedLayout)
+        return false;
+
+    layout = *reflectedLayout;
+    data.assign(layout.size, 0);
+    applyDefaults(layout, data.data());
+
+    buffer = std::make_unique<UniformBuffer>(binding, layout.size);
+    dirty = true;
+    return true;
+}
+
+void ParameterBlock::bind() {
+    if (!buffer)
+        return;
+
+    if (dirty) {
+        buffer->update(static_cast<const void*>(data.data()));
+        uploads++;
+        dirty = false;
+    }
+    buffer->bind();
+}
+
+void ParameterBlock::applyDefaults(const BlockLayout &layout, void *data) {
+    for (const ParameterField &field : layout.fields) {
+        if (field.defaults.empty())
+            continue;
+        // Defaults never write past a vec4, the largest annotated type, or the end of the block
+        size_t count = std::min<size_t>(field.defaults.size(), 4);
+        count = std::min<size_t>(count, (layout.size - field.offset) / sizeof(float));
+        std::memcpy(static_cast<unsigned char*>(data) + field.offset, field.defaults.data(), count * sizeof(float));
+    }
+}
+
+std::string ParameterBlock::literal(unsigned int type, const void *value) {
+    const float *values = static_cast<const float*>(value);
+    switch (type) {
+        case GL_FLOAT:
+            return floatLiteral(values[0]);
+        case GL_FLOAT_VEC2:
+            return vectorLiteral("vec2", values, 2);
+        case GL_FLOAT_VEC3:
+            return vectorLiteral("vec3", values, 3);
+        case GL_FLOAT_VEC4:
+            return vectorLiteral("vec4", values, 4);
+        case GL_INT:
+            return std::to_string(*static_cast<const int*>(value));
+        case GL_BOOL:
+            return *static_cast<const unsigned int*>(value) ? "true" : "false";
+        default:
+            return "";
+    }
+}
+
+std::string ParameterBlock::constructor(const std::string &structName) const {
+    std::string result = structName + "(";
+    for (size_t i = 0; i < layout.fields.size(); i++) {
+        const ParameterField &field = layout.fields[i];
+        std::string value = literal(field.type, data.data() + field.offset);
+        if (value.empty())
+            return "";
+        result += (i ? ", " : "") + value;
+    }
+    return result + ")";
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Shader.h"
+#include "UniformBuffer.h"
+
+/*
+ * CPU copy of a uniform block described by shader reflection, e.g. a shading
+ * model's Material. The whole block lives in one contiguous buffer and is
+ * uploaded with a single call when it was edited since the last bind.
+ *
+ * */
+
+class ParameterBlock {
+public:
+    explicit ParameterBlock(unsigned int binding);
+
+    // Takes the layout of the named block from a ready shader and fills in the annotated defaults
+    bool reflect(const Shader &shader, const std::string &blockName);
+    bool reflected() const { return buffer != nullptr; }
+
+    // Uploads the block if dirty and attaches it to its binding point
+    void bind();
+
+    static void applyDefaults(const BlockLayout &layout, void *data);
+
+    // GLSL constant expressions, e.g. "vec3(0.6, 0.3, 0.7)". Empty for unsupported types.
+    static std::string literal(unsigned int type, const void *value);
+    // Constructor of the struct mirroring the block, e.g. "MaterialData(vec3(1.0, 1.0, 1.0), 32.0)"
+    std::string constructor(const std::string &structName) const;
+
+    BlockLayout layout;
+    std::vector<unsigned char> data;
+    bool dirty = true;
+
+    static int uploads;
+
+private:
+    unsigned int binding;
+    std::unique_ptr<UniformBuffer> buffer;
+};
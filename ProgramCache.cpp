@@ -0,0 +1,131 @@
+#include "ProgramCache.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+#include <glad/glad.h>
+
+std::string ProgramCache::directory = "shader_cache";
+int ProgramCache::hits = 0;
+int ProgramCache::misses = 0;
+
+namespace {
+    const uint32_t CACHE_MAGIC = 0x42505345; // "ESPB"
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    // FNV-1a, 64 bit
+    uint64_t hashBytes(uint64_t hash, const char *data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (uint8_t)data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t hashString(uint64_t hash, const char *str) {
+        // Include the terminator so "ab" + "c" and "a" + "bc" hash differently
+        return str ? hashBytes(hash, str, std::char_traits<char>::length(str) + 1) : hash;
+    }
+
+    std::string entryPath(const std::string &key) {
+        return ProgramCache::directory + "/" + key + ".bin";
+    }
+}
+
+bool ProgramCache::supported() {
+    // Queried once, requires a current context
+    static const bool available = [] {
+        if (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary)
+            return false;
+
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return available;
+}
+
+std::string ProgramCache::key(const std::string &vertexCode, const std::string &fragmentCode) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = hashString(hash, vertexCode.c_str());
+    hash = hashString(hash, fragmentCode.c_str());
+    hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+    hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+    hash = hashString(hash, (const char*)glGetString(GL_VERSION));
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return std::string(hex);
+}
+
+bool ProgramCache::load(unsigned int program, const std::string &key) {
+    if (!supported())
+        return false;
+
+    std::ifstream file(entryPath(key), std::ios::binary);
+    CacheHeader header{};
+    if (!file || !file.read((char*)&header, sizeof(header)) || header.magic != CACHE_MAGIC) {
+        misses++;
+        return false;
+    }
+
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length)) {
+        misses++;
+        return false;
+    }
+
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+    // The driver may reject binaries from an older build, fall back to compiling
+    int success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        misses++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+void ProgramCache::store(unsigned int program, const std::string &key) {
+    if (!supported())
+        return;
+
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    CacheHeader header{CACHE_MAGIC, 0, 0};
+    glGetProgramBinary(program, length, &length, &header.format, binary.data());
+    header.length = (uint32_t)length;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    // Write to a temporary file first so a crash never leaves a truncated entry
+    std::string path = entryPath(key);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "ERROR::PROGRAM_CACHE::WRITE_FAILED: " << tempPath << std::endl;
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+    }
+    std::filesystem::rename(tempPath, path, error);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+/*
+ * On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary).
+ * Entries are keyed by the shader sources and the GL vendor, renderer and
+ * version strings, so a driver update invalidates them automatically.
+ *
+ * */
+
+class ProgramCache {
+public:
+    static bool supported();
+    static std::string key(const std::string &vertexCode, const std::string &fragmentCode);
+
+    // Loads a cached binary into program, returns false if missing or rejected by the driver
+    static bool load(unsigned int program, const std::string &key);
+    static void store(unsigned int program, const std::string &key);
+
+    static std::string directory;
+    static int hits;
+    static int misses;
+};
@@ -0,0 +1,206 @@
+#include "SceneCulling.h"
+
+#include <map>
+#include <utility>
+
+namespace {
+    const int CULL_GROUP_SIZE = 64;     // local_size_x of shaders/cullC.glsl
+
+    // Draw counts come straight from the count buffer from GL 4.6 on
+    bool drawCountsOnGpu() {
+        return GLAD_GL_VERSION_4_6;
+    }
+
+    unsigned int createBuffer(GLenum target, size_t size, const void *data, GLenum usage) {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, size, data, usage);
+        glBindBuffer(target, 0);
+        return buffer;
+    }
+
+    void deleteBuffer(unsigned int &buffer) {
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+SceneCulling::~SceneCulling() {
+    clear();
+}
+
+bool SceneCulling::supported() {
+    return GLAD_GL_VERSION_4_3;
+}
+
+void SceneCulling::clear() {
+    for (unsigned int *buffer : {&objectBuffer, &commandBuffer, &batchBuffer, &countBuffer, &transformBuffer, &readbackBuffer})
+        deleteBuffer(*buffer);
+    if (readbackFence)
+        glDeleteSync(readbackFence);
+    readbackFence = nullptr;
+    objectCount = 0;
+    batchList.clear();
+    cullStats = CullStats();
+}
+
+void SceneCulling::build(const GltfScene &scene) {
+    clear();
+    if (!supported())
+        return;
+    if (!cullShader)
+        cullShader = std::make_unique<Shader>("shaders/cullC.glsl");
+
+    // Draws of one material only need another batch when their meshes cannot share a multi-draw
+    std::map<std::pair<int, unsigned int>, std::vector<size_t>> candidates;     // (material, vertex array) -> batches
+    for (size_t i = 0; i < scene.draws.size(); i++) {
+        const GltfDraw &item = scene.draws[i];
+        const Mesh &mesh = scene.meshes[item.mesh];
+        if (!mesh.VAO)
+            continue;
+
+        std::vector<size_t> &matching = candidates[{item.material, mesh.VAO}];
+        size_t batch = batchList.size();
+        for (size_t candidate : matching)
+            if (scene.meshes[batchList[candidate].mesh].sharesDrawState(mesh)) {
+                batch = candidate;
+                break;
+            }
+        if (batch == batchList.size()) {
+            batchList.push_back({item.material, item.mesh, {}, 0});
+            matching.push_back(batch);
+        }
+        batchList[batch].draws.push_back(i);
+    }
+
+    // Objects are sorted by batch, so each batch's commands are one contiguous range
+    std::vector<CullObject> objects;
+    std::vector<GLuint> batchFirst;
+    for (size_t batch = 0; batch < batchList.size(); batch++) {
+        batchList[batch].first = objects.size();
+        batchFirst.push_back((GLuint)objects.size());
+        for (size_t index : batchList[batch].draws) {
+            const GltfDraw &item = scene.draws[index];
+            DrawElementsIndirectCommand command = scene.meshes[item.mesh].indirectCommand();
+            CullObject object;
+            object.transform = item.transform;
+            object.boundsMin = glm::vec4(item.boundsMin, 0.0f);
+            object.boundsMax = glm::vec4(item.boundsMax, 0.0f);
+            object.command = glm::uvec4(command.count, command.firstIndex, (GLuint)command.baseVertex, (GLuint)batch);
+            objects.push_back(object);
+        }
+    }
+    objectCount = objects.size();
+    cullStats.objects = objectCount;
+    cullStats.drawCalls = batchList.size();
+    cullStats.gpu = true;
+    if (objectCount == 0)
+        return;
+
+    objectBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(CullObject), objects.data(), GL_STATIC_DRAW);
+    batchBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, batchFirst.size() * sizeof(GLuint), batchFirst.data(), GL_STATIC_DRAW);
+    commandBuffer = createBuffer(GL_DRAW_INDIRECT_BUFFER, objectCount * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+    countBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, batchList.size() * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    transformBuffer = createBuffer(GL_ARRAY_BUFFER, objectCount * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    readbackBuffer = createBuffer(GL_COPY_WRITE_BUFFER, batchList.size() * sizeof(GLuint), nullptr, GL_STREAM_READ);
+}
+
+void SceneCulling::cull(const glm::mat4 &sceneTransform, const glm::mat4 &viewProjection) {
+    if (!ready())
+        return;
+    readCounts();
+
+    static const UniformHandle sceneTransformHandle = Shader::handle("sceneTransform");
+    static const UniformHandle viewProjectionHandle = Shader::handle("viewProjection");
+    static const UniformHandle objectCountHandle = Shader::handle("objectCount");
+    cullShader->use();
+    cullShader->setMat4(sceneTransformHandle, sceneTransform);
+    cullShader->setMat4(viewProjectionHandle, viewProjection);
+    cullShader->setInt(objectCountHandle, (int)objectCount);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    if (!drawCountsOnGpu()) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, batchBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, countBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, transformBuffer);
+    glDispatchCompute((GLuint)((objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glUseProgram(0);
+
+    // Only one readback is in flight, frames in between are not counted
+    if (!readbackFence) {
+        glBindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, batchList.size() * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+// Takes the counts of an earlier frame if the GPU is done with it, never waits
+void SceneCulling::readCounts() {
+    if (!readbackFence)
+        return;
+    GLenum status = glClientWaitSync(readbackFence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return;
+    glDeleteSync(readbackFence);
+    readbackFence = nullptr;
+
+    std::vector<GLuint> counts(batchList.size());
+    glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, counts.size() * sizeof(GLuint), counts.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    cullStats.visible = 0;
+    for (GLuint count : counts)
+        cullStats.visible += count;
+}
+
+void SceneCulling::draw(size_t batch, const GltfScene &scene, Shader &shader, GLenum mode) const {
+    if (!ready() || batch >= batchList.size())
+        return;
+
+    InstanceBuffer instances;
+    instances.buffer = transformBuffer;
+    instances.vec4Count = 4;
+
+    IndirectCommands commands;
+    commands.buffer = commandBuffer;
+    commands.offset = batchList[batch].first * sizeof(DrawElementsIndirectCommand);
+    commands.maxDraws = (int)batchList[batch].draws.size();
+    if (drawCountsOnGpu()) {
+        commands.countBuffer = countBuffer;
+        commands.countOffset = batch * sizeof(GLuint);
+    }
+    scene.meshes[batchList[batch].mesh].drawIndirect(shader, mode, instances, commands);
+}
+
+bool SceneCulling::visible(const glm::mat4 &model, const glm::mat4 &viewProjection,
+                           const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 center(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+    glm::mat3 absolute(model);
+    for (int column = 0; column < 3; column++)
+        absolute[column] = glm::abs(absolute[column]);
+    glm::vec3 extent = absolute * ((boundsMax - boundsMin) * 0.5f);
+
+    // Planes of the frustum in world space, left, right, bottom, top, near, far
+    glm::mat4 rows = glm::transpose(viewProjection);
+    for (int i = 0; i < 6; i++) {
+        glm::vec4 plane = rows[3] + (i % 2 == 0 ? rows[i / 2] : -rows[i / 2]);
+        if (glm::dot(glm::vec3(plane), center) + plane.w + glm::dot(glm::abs(glm::vec3(plane)), extent) < 0.0f)
+            return false;
+    }
+    return true;
+}
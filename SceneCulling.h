@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GltfScene.h"
+#include "Mesh.h"
+#include "Shader.h"
+
+// Draws of one material whose meshes share their draw state, covered by a single multi-draw
+struct CullBatch {
+    int material;                   // Index into GltfScene::materials, -1 for the default material
+    int mesh;                       // Drawn with this mesh's vertex array and decode parameters
+    std::vector<size_t> draws;      // Indices into GltfScene::draws
+    size_t first = 0;               // Its first command, batches are laid out in order
+};
+
+struct CullStats {
+    size_t objects = 0;
+    size_t visible = 0;
+    size_t drawCalls = 0;   // One multi-draw per batch on the GPU path, one per visible draw on the CPU path
+    bool gpu = false;
+
+    size_t culled() const { return objects - visible; }
+};
+
+/*
+ * GPU-driven drawing of a GltfScene. The bounds and transforms of all draws
+ * live in a shader storage buffer, shaders/cullC.glsl frustum culls them and
+ * writes the indirect commands of the visible ones, compacted per batch, and
+ * the visible count of each batch. Every batch is then drawn with one
+ * glMultiDrawElementsIndirect, the world transforms reach the vertex shader
+ * as an instanced attribute selected by the commands' base instance.
+ *
+ * GL 4.6 reads the draw counts straight from the count buffer. On 4.3 the
+ * commands are cleared every frame and each batch draws its full capacity,
+ * the cleared commands draw nothing. The counts in stats are read back once
+ * the GPU finished a frame, so they trail the drawing by a frame or two.
+ *
+ * Contexts below 4.3 draw the scene on the CPU, see visible().
+ *
+ * */
+
+class SceneCulling {
+public:
+    SceneCulling() = default;
+    ~SceneCulling();
+
+    SceneCulling(const SceneCulling&) = delete;
+    SceneCulling& operator=(const SceneCulling&) = delete;
+
+    static bool supported();
+
+    // Groups the draws into batches and uploads their bounds, again after every load
+    void build(const GltfScene &scene);
+    void clear();
+    // Culls every draw against the frustum of viewProjection, sceneTransform is applied first
+    void cull(const glm::mat4 &sceneTransform, const glm::mat4 &viewProjection);
+    // shader needs the INDIRECT_DRAW variant of shaders/PBRvertex.glsl
+    void draw(size_t batch, const GltfScene &scene, Shader &shader, GLenum mode) const;
+    bool ready() const { return cullShader && cullShader->ready() && objectCount > 0; }
+
+    const std::vector<CullBatch>& batches() const { return batchList; }
+    const CullStats& stats() const { return cullStats; }
+
+    // CPU frustum test of a mesh's bounds under model, the same test the compute shader runs
+    static bool visible(const glm::mat4 &model, const glm::mat4 &viewProjection,
+                        const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+private:
+    // One draw as read by shaders/cullC.glsl
+    struct CullObject {
+        glm::mat4 transform;
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        glm::uvec4 command;     // Index count, first index, base vertex, batch
+    };
+
+    std::unique_ptr<Shader> cullShader;
+    unsigned int objectBuffer = 0;
+    unsigned int commandBuffer = 0;
+    unsigned int batchBuffer = 0;
+    unsigned int countBuffer = 0;
+    unsigned int transformBuffer = 0;
+    unsigned int readbackBuffer = 0;    // Copy of the counts, read once its fence signals
+    GLsync readbackFence = nullptr;
+    size_t objectCount = 0;
+    std::vector<CullBatch> batchList;
+    CullStats cullStats;
+
+    void readCounts();
+};
@@ -1,87 +1,703 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <regex>
+#include <unordered_map>
+#include <cstring>
 
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
 #include "Shader.h"
+#include "UniformBuffer.h"
+#include "ProgramCache.h"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace {
+    const int MAX_INCLUDE_DEPTH = 16;
+
+    // Uniform names are interned once for all programs in a flat open addressing table
+    struct NameSlot {
+        uint32_t hash = 0;
+        int id = -1;
+    };
+
+    std::vector<std::string> uniformNames;
+    std::vector<NameSlot> nameTable(64);
+
+    // FNV-1a
+    uint32_t hashName(const std::string &name) {
+        uint32_t hash = 2166136261u;
+        for (char c : name) {
+            hash ^= (uint8_t)c;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    void insertName(uint32_t hash, int id) {
+        size_t mask = nameTable.size() - 1;
+        size_t slot = hash & mask;
+        while (nameTable[slot].id >= 0)
+            slot = (slot + 1) & mask;
+        nameTable[slot] = NameSlot{hash, id};
+    }
+
+    int internName(const std::string &name) {
+        uint32_t hash = hashName(name);
+        size_t mask = nameTable.size() - 1;
+        for (size_t slot = hash & mask; nameTable[slot].id >= 0; slot = (slot + 1) & mask) {
+            const NameSlot &entry = nameTable[slot];
+            if (entry.hash == hash && uniformNames[entry.id] == name)
+                return entry.id;
+        }
+
+        int id = (int)uniformNames.size();
+        uniformNames.push_back(name);
+
+        // Keep the table at most half full so probe sequences stay short
+        if (uniformNames.size() * 2 > nameTable.size()) {
+            std::vector<NameSlot> old = std::move(nameTable);
+            nameTable.assign(old.size() * 2, NameSlot{});
+            for (const NameSlot &entry : old)
+                if (entry.id >= 0)
+                    insertName(entry.hash, entry.id);
+        }
+        insertName(hash, id);
+        return id;
+    }
+
+    bool readFile(const std::string &path, std::string &contents) {
+        std::ifstream file;
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try {
+            file.open(path);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            contents = stream.str();
+        } catch (std::ifstream::failure& e) {
+            std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Copies path into code with every #include "file" replaced by the file's contents. Each file
+    // gets a source string number and #line directives keep driver messages on the right line.
+    bool expandIncludes(const std::string &path, std::string &code, std::vector<std::string> &files, int depth) {
+        std::string source;
+        if (!readFile(path, source))
+            return false;
+
+        int fileId = (int)files.size();
+        files.push_back(path);
+
+        std::istringstream lines(source);
+        std::string line;
+        int lineNumber = 0;
+        bool success = true;
+        while (std::getline(lines, line)) {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+                code += line;
+                code += '\n';
+                continue;
+            }
+
+            // Directives are replaced by an empty line so the following line numbers stay intact
+            code += '\n';
+
+            size_t open = line.find('"', start + 8);
+            size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                std::cerr << "ERROR::SHADER::MALFORMED_INCLUDE: " << path << ":" << lineNumber << std::endl;
+                success = false;
+                continue;
+            }
+
+            std::filesystem::path includePath = std::filesystem::path(path).parent_path() / line.substr(open + 1, close - open - 1);
+            std::string includeFile = includePath.lexically_normal().generic_string();
+
+            // Every file is included at most once per stage, which works as an implicit include guard
+            if (std::find(files.begin(), files.end(), includeFile) != files.end())
+                continue;
+
+            if (depth >= MAX_INCLUDE_DEPTH) {
+                std::cerr << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << includeFile << std::endl;
+                success = false;
+                continue;
+            }
+
+            code += "#line 1 " + std::to_string(files.size()) + "\n";
+            success = expandIncludes(includeFile, code, files, depth + 1) && success;
+            code += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileId) + "\n";
+        }
+        return success;
+    }
+
+    // Reads the annotations trailing member declarations: @color, @range min max and @default values
+    void parseAnnotations(const std::string &code, std::unordered_map<std::string, ParameterField> &annotations) {
+        std::istringstream lines(code);
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t comment = line.find("//");
+            if (comment == std::string::npos || line.find('@', comment) == std::string::npos)
+                continue;
+            size_t end = line.rfind(';', comment);
+            if (end == std::string::npos)
+                continue;
+
+            // The member name is the last identifier before the semicolon, without array size
+            std::string declaration = line.substr(0, end);
+            size_t bracket = declaration.find('[');
+            if (bracket != std::string::npos)
+                declaration.resize(bracket);
+            size_t last = declaration.find_last_not_of(" \t");
+            if (last == std::string::npos)
+                continue;
+            size_t first = declaration.find_last_of(" \t", last);
+            first = first == std::string::npos ? 0 : first + 1;
+
+            ParameterField field;
+            field.name = declaration.substr(first, last - first + 1);
+            field.annotated = true;
+
+            std::istringstream tags(line.substr(comment + 2));
+            std::string tag;
+            while (tags >> tag) {
+                if (tag == "@color") {
+                    field.color = true;
+                } else if (tag == "@range") {
+                    tags >> field.min >> field.max;
+                } else if (tag == "@default") {
+                    float value;
+                    while (tags >> value)
+                        field.defaults.push_back(value);
+                    tags.clear();
+                }
+            }
+            annotations[field.name] = field;
+        }
+    }
+
+    // Replaces source string numbers in driver logs ("0:12(3):" or "0(12) :") with file names
+    std::string mapSourceFiles(const std::string &log, const std::vector<std::string> &files) {
+        if (files.empty())
+            return log;
+
+        static const std::regex location(R"((^|\n)(ERROR: |WARNING: )?(\d+)([:(]\d+))");
+        std::string result;
+        auto last = log.cbegin();
+        for (std::sregex_iterator match(log.begin(), log.end(), location), end; match != end; ++match) {
+            size_t id = std::stoul((*match)[3].str());
+            result.append(last, (*match)[0].first);
+            result += (*match)[1].str() + (*match)[2].str();
+            result += id < files.size() ? files[id] : (*match)[3].str();
+            result += (*match)[4].str();
+            last = (*match)[0].second;
+        }
+        result.append(last, log.cend());
+        return result;
+    }
+}
+
+Shader::Shader(const char *vsPath, const char *fsPath, bool deferred, const ShaderDefines &defines)
+    : ID(0), state(ShaderState::Idle), vsPath(vsPath), fsPath(fsPath), defines(defines) {
+    if (!deferred) {
+        beginCompile();
+        pollCompile(false);
+    }
+}
+
+Shader::Shader(const char *csPath, const ShaderDefines &defines)
+    : ID(0), state(ShaderState::Idle), vsPath(csPath), defines(defines) {
+    beginCompile();
+    pollCompile(false);
+}
+
+Shader::~Shader() {
+    if (separable && ID)
+        glDeleteProgramPipelines(1, &ID);
+}
+
+Shader::Program::~Program() {
+    for (unsigned int stage : stages)
+        glDeleteShader(stage);
+    if (ID)
+        glDeleteProgram(ID);
+}
+
+unsigned long long Shader::uploadsIssued = 0;
+unsigned long long Shader::uploadsSkipped = 0;
+
+bool Shader::separableSupported() {
+    return GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_separate_shader_objects;
+}
+
+// Submits all stages and links without waiting on the result
+void Shader::beginCompile() {
+    if (state != ShaderState::Idle)
+        return;
+
+    if (fsPath.empty()) {
+        std::string computeCode;
+        std::vector<std::string> computeFiles;
+        preprocess(vsPath, computeCode, computeFiles);
+        computeCode = injectDefines(computeCode, defines);
+
+        state = ShaderState::Compiling;
+        program = std::make_shared<Program>();
+        program->cacheKey = ProgramCache::key(computeCode, "");
+        program->sourceFiles = {computeFiles};
+        submitProgram(*program, {GL_COMPUTE_SHADER}, {computeCode}, false);
+        return;
+    }
 
-Shader::Shader(const char *vsPath, const char *fsPath) {
     std::string vertexCode;
     std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+    std::vector<std::string> vertexFiles;
+    std::vector<std::string> fragmentFiles;
+
+    preprocess(vsPath, vertexCode, vertexFiles);
+    preprocess(fsPath, fragmentCode, fragmentFiles);
+    vertexCode = injectDefines(vertexCode, defines);
+    fragmentCode = injectDefines(fragmentCode, defines);
+
+    annotations.clear();
+    parseAnnotations(vertexCode, annotations);
+    parseAnnotations(fragmentCode, annotations);
+
+    state = ShaderState::Compiling;
+    separable = separableSupported();
+
+    if (separable) {
+        // Vertex stages are shared by every shader with the same preprocessed vertex source
+        static std::unordered_map<std::string, std::weak_ptr<Program>> vertexPrograms;
+
+        std::string vertexKey = ProgramCache::key(vertexCode, "");
+        vertexProgram = vertexPrograms[vertexKey].lock();
+        if (!vertexProgram) {
+            vertexProgram = std::make_shared<Program>();
+            vertexProgram->cacheKey = vertexKey;
+            vertexProgram->sourceFiles = {vertexFiles};
+            submitProgram(*vertexProgram, {GL_VERTEX_SHADER}, {vertexCode}, true);
+            vertexPrograms[vertexKey] = vertexProgram;
+        }
+
+        program = std::make_shared<Program>();
+        program->cacheKey = ProgramCache::key("", fragmentCode);
+        program->sourceFiles = {fragmentFiles};
+        submitProgram(*program, {GL_FRAGMENT_SHADER}, {fragmentCode}, true);
+    } else {
+        program = std::make_shared<Program>();
+        program->cacheKey = ProgramCache::key(vertexCode, fragmentCode);
+        program->sourceFiles = {vertexFiles, fragmentFiles};
+        submitProgram(*program, {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}, {vertexCode, fragmentCode}, false);
+    }
+}
+
+bool Shader::preprocess(const std::string &path, std::string &code, std::vector<std::string> &files) {
+    return expandIncludes(path, code, files, 0);
+}
+
+std::string Shader::variantKey(const ShaderDefines &defines) {
+    std::string key;
+    for (const auto &[name, value] : defines) {
+        key += name;
+        if (!value.empty())
+            key += "=" + value;
+        key += ";";
+    }
+    return key;
+}
+
+// Defines must follow #version, a #line directive keeps error messages on the original line numbers
+std::string Shader::injectDefines(const std::string &code, const ShaderDefines &defines) {
+    if (defines.empty())
+        return code;
+
+    size_t version = code.find("#version");
+    size_t insertAt = version == std::string::npos ? 0 : code.find('\n', version);
+    if (insertAt == std::string::npos)
+        insertAt = code.size();
+    else if (version != std::string::npos)
+        insertAt++;
+
+    int nextLine = 1 + (int)std::count(code.begin(), code.begin() + insertAt, '\n');
+
+    std::string prelude;
+    for (const auto &[name, value] : defines)
+        prelude += "#define " + name + " " + value + "\n";
+    prelude += "#line " + std::to_string(nextLine) + " 0\n";
+
+    return code.substr(0, insertAt) + prelude + code.substr(insertAt);
+}
+
+void Shader::submitProgram(Program &program, const std::vector<unsigned int> &types,
+                           const std::vector<std::string> &sources, bool separable) {
+    program.ID = glCreateProgram();
+    if (separable)
+        glProgramParameteri(program.ID, GL_PROGRAM_SEPARABLE, GL_TRUE);
+
+    if (ProgramCache::load(program.ID, program.cacheKey)) {
+        program.state = ShaderState::Ready;
+        return;
+    }
+
+    glDeleteProgram(program.ID);
+    program.ID = glCreateProgram();
+    if (separable)
+        glProgramParameteri(program.ID, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    if (ProgramCache::supported())
+        glProgramParameteri(program.ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    for (size_t i = 0; i < types.size(); i++) {
+        const char* code = sources[i].c_str();
+        unsigned int stage = glCreateShader(types[i]);
+        glShaderSource(stage, 1, &code, nullptr);
+        glCompileShader(stage);
+        glAttachShader(program.ID, stage);
 
-    try {
-        vShaderFile.open(vsPath);
-        fShaderFile.open(fsPath);
-        std::stringstream vShaderStream, fShaderStream;
+        program.stages.push_back(stage);
+        program.stageNames.emplace_back(types[i] == GL_VERTEX_SHADER ? "VERTEX" : types[i] == GL_COMPUTE_SHADER ? "COMPUTE" : "FRAGMENT");
+    }
 
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+    glLinkProgram(program.ID);
+    program.state = ShaderState::Compiling;
+}
 
-        vShaderFile.close();
-        fShaderFile.close();
+// Returns true once the program is finished. With parallel compilation the driver is
+// only asked for the completion status, which never blocks.
+bool Shader::pollProgram(Program &program, bool parallel) {
+    if (program.state != ShaderState::Compiling)
+        return true;
 
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+    if (parallel) {
+        int complete = 0;
+        glGetProgramiv(program.ID, GL_COMPLETION_STATUS_KHR, &complete);
+        if (!complete)
+            return false;
+    }
 
-    } catch (std::ifstream::failure& e) {
-        std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    bool success = true;
+    for (size_t i = 0; i < program.stages.size(); i++)
+        success = checkCompileErrors(program.stages[i], program.stageNames[i], program.sourceFiles[i]) && success;
+    success = checkCompileErrors(program.ID, "PROGRAM") && success;
+
+    for (unsigned int stage : program.stages) {
+        glDetachShader(program.ID, stage);
+        glDeleteShader(stage);
     }
+    program.stages.clear();
+
+    if (success)
+        ProgramCache::store(program.ID, program.cacheKey);
+
+    program.state = success ? ShaderState::Ready : ShaderState::Failed;
+    return true;
+}
+
+bool Shader::pollCompile(bool parallel) {
+    if (state != ShaderState::Compiling)
+        return state != ShaderState::Idle;
+
+    bool done = pollProgram(*program, parallel);
+    if (vertexProgram)
+        done = pollProgram(*vertexProgram, parallel) && done;
+    if (!done)
+        return false;
+
+    finishCompile();
+    return true;
+}
 
-    const char* vsCode = vertexCode.c_str();
-    const char* fsCode = fragmentCode.c_str();
-    unsigned int vertex, fragment;
+void Shader::finishCompile() {
+    if (program->state == ShaderState::Failed || (vertexProgram && vertexProgram->state == ShaderState::Failed)) {
+        state = ShaderState::Failed;
+        return;
+    }
 
-    // Vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vsCode, nullptr);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
+    std::vector<Program*> programs = {program.get()};
+    if (separable) {
+        glGenProgramPipelines(1, &ID);
+        glUseProgramStages(ID, GL_VERTEX_SHADER_BIT, vertexProgram->ID);
+        glUseProgramStages(ID, GL_FRAGMENT_SHADER_BIT, program->ID);
+        programs.push_back(vertexProgram.get());
+    } else {
+        ID = program->ID;
+    }
 
-    // Fragment shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fsCode, nullptr);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    for (Program *stageProgram : programs) {
+        reflectUniforms(*stageProgram);
+        reflectBlocks(*stageProgram);
 
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+        // Attach the shared blocks to their fixed binding points
+        unsigned int frameBlock = glGetUniformBlockIndex(stageProgram->ID, FRAME_DATA_BLOCK);
+        if (frameBlock != GL_INVALID_INDEX)
+            glUniformBlockBinding(stageProgram->ID, frameBlock, FRAME_DATA_BINDING);
 
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+        unsigned int materialBlock = glGetUniformBlockIndex(stageProgram->ID, MATERIAL_BLOCK);
+        if (materialBlock != GL_INVALID_INDEX)
+            glUniformBlockBinding(stageProgram->ID, materialBlock, MATERIAL_BINDING);
+    }
 
+    state = ShaderState::Ready;
 }
 
 void Shader::use() {
-    glUseProgram(ID);
+    if (separable) {
+        // A bound program takes precedence over the pipeline
+        glUseProgram(0);
+        glBindProgramPipeline(ID);
+    } else {
+        glUseProgram(ID);
+    }
+}
+
+UniformHandle Shader::handle(const std::string &name) {
+    return UniformHandle{internName(name)};
+}
+
+UniformHandle Shader::uniform(const std::string &name) const {
+    UniformHandle result = handle(name);
+    // Reports the name right away if it is not active in this program
+    if (ready())
+        find(result);
+    return result;
+}
+
+bool Shader::active(UniformHandle handle) const {
+    return handle.id >= 0 && handle.id < (int)uniformByName.size() && uniformByName[handle.id] >= 0;
+}
+
+const Shader::UniformInfo* Shader::find(UniformHandle handle) const {
+    if (active(handle))
+        return &uniforms[uniformByName[handle.id]];
+
+    if (handle.valid() && missingUniforms.insert(handle.id).second) {
+        std::cerr << "ERROR::SHADER::UNIFORM_NOT_FOUND: " << uniformNames[handle.id]
+        << " is not an active uniform in " << vsPath << (fsPath.empty() ? "" : " + " + fsPath) << std::endl;
+    }
+    return nullptr;
+}
+
+void Shader::setBool(UniformHandle handle, bool value) const {
+    setInt(handle, (int)value);
+}
+
+void Shader::setInt(UniformHandle handle, int value) const {
+    if (const UniformInfo *info = find(handle))
+        for (int i = 0; i < info->count; i++) {
+            if (!changed(*info->shadow[i], &value, sizeof(value)))
+                continue;
+            if (separable)
+                glProgramUniform1i(info->program[i], info->location[i], value);
+            else
+                glUniform1i(info->location[i], value);
+        }
+}
+
+void Shader::setFloat(UniformHandle handle, float value) const {
+    if (const UniformInfo *info = find(handle))
+        for (int i = 0; i < info->count; i++) {
+            if (!changed(*info->shadow[i], &value, sizeof(value)))
+                continue;
+            if (separable)
+                glProgramUniform1f(info->program[i], info->location[i], value);
+            else
+                glUniform1f(info->location[i], value);
+        }
+}
+
+void Shader::setMat4(UniformHandle handle, const glm::mat4 &value) const {
+    if (const UniformInfo *info = find(handle))
+        for (int i = 0; i < info->count; i++) {
+            if (!changed(*info->shadow[i], glm::value_ptr(value), sizeof(value)))
+                continue;
+            if (separable)
+                glProgramUniformMatrix4fv(info->program[i], info->location[i], 1, GL_FALSE, glm::value_ptr(value));
+            else
+                glUniformMatrix4fv(info->location[i], 1, GL_FALSE, glm::value_ptr(value));
+        }
+}
+
+void Shader::setVec3(UniformHandle handle, const glm::vec3 &value) const {
+    if (const UniformInfo *info = find(handle))
+        for (int i = 0; i < info->count; i++) {
+            if (!changed(*info->shadow[i], glm::value_ptr(value), sizeof(value)))
+                continue;
+            if (separable)
+                glProgramUniform3fv(info->program[i], info->location[i], 1, glm::value_ptr(value));
+            else
+                glUniform3fv(info->location[i], 1, glm::value_ptr(value));
+        }
+}
+
+void Shader::setVec4(UniformHandle handle, const glm::vec4 &value) const {
+    if (const UniformInfo *info = find(handle))
+        for (int i = 0; i < info->count; i++) {
+            if (!changed(*info->shadow[i], glm::value_ptr(value), sizeof(value)))
+                continue;
+            if (separable)
+                glProgramUniform4fv(info->program[i], info->location[i], 1, glm::value_ptr(value));
+            else
+                glUniform4fv(info->location[i], 1, glm::value_ptr(value));
+        }
+}
+
+// Uniform values are program state, so a bit-identical value is already in place
+bool Shader::changed(UniformShadow &shadow, const void *value, size_t size) {
+    if (shadow.valid && std::memcmp(shadow.bytes, value, size) == 0) {
+        uploadsSkipped++;
+        return false;
+    }
+    std::memcpy(shadow.bytes, value, size);
+    shadow.valid = true;
+    uploadsIssued++;
+    return true;
 }
 
 void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    setBool(handle(name), value);
 }
 
 void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setInt(handle(name), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setFloat(handle(name), value);
 }
 
 void Shader::setMat4(const std::string &name, glm::mat4 value) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+    setMat4(handle(name), value);
+}
+
+void Shader::setVec3(const std::string &name, const glm::vec3 &value) const {
+    setVec3(handle(name), value);
+}
+
+void Shader::reflectUniforms(Program &program) {
+    int count = 0, maxLength = 0;
+    glGetProgramiv(program.ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program.ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+    for (int i = 0; i < count; i++) {
+        int length = 0, size = 0;
+        GLenum type;
+        glGetActiveUniform(program.ID, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+        std::string name(buffer.data(), length);
+
+        // Members of uniform blocks have no location of their own
+        int location = glGetUniformLocation(program.ID, name.c_str());
+        if (location < 0)
+            continue;
+
+        addUniform(name, program, location, type);
+
+        // Arrays of basic types are reported once as "name[0]", register every element
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            std::string base = name.substr(0, name.size() - 3);
+            addUniform(base, program, location, type);
+            for (int element = 1; element < size; element++) {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                addUniform(elementName, program, glGetUniformLocation(program.ID, elementName.c_str()), type);
+            }
+        }
+    }
+}
+
+void Shader::reflectBlocks(const Program &program) {
+    int blockCount = 0;
+    glGetProgramiv(program.ID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+
+    for (int blockIndex = 0; blockIndex < blockCount; blockIndex++) {
+        char nameBuffer[256];
+        int length = 0;
+        glGetActiveUniformBlockName(program.ID, blockIndex, sizeof(nameBuffer), &length, nameBuffer);
+
+        // Blocks used by both separable stages are only described once
+        BlockLayout layout;
+        layout.name = std::string(nameBuffer, length);
+        if (block(layout.name))
+            continue;
 
+        int memberCount = 0;
+        glGetActiveUniformBlockiv(program.ID, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &layout.size);
+        glGetActiveUniformBlockiv(program.ID, blockIndex, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &memberCount);
+
+        std::vector<int> indices(memberCount), offsets(memberCount), types(memberCount);
+        glGetActiveUniformBlockiv(program.ID, blockIndex, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+        std::vector<unsigned int> members(indices.begin(), indices.end());
+        glGetActiveUniformsiv(program.ID, memberCount, members.data(), GL_UNIFORM_OFFSET, offsets.data());
+        glGetActiveUniformsiv(program.ID, memberCount, members.data(), GL_UNIFORM_TYPE, types.data());
+
+        for (int i = 0; i < memberCount; i++) {
+            glGetActiveUniformName(program.ID, members[i], sizeof(nameBuffer), &length, nameBuffer);
+            std::string name(nameBuffer, length);
+
+            // Members of named blocks are reported as "Block.member"
+            if (name.compare(0, layout.name.size() + 1, layout.name + ".") == 0)
+                name.erase(0, layout.name.size() + 1);
+
+            // Annotations are looked up by the innermost member name
+            size_t dot = name.find_last_of('.');
+            std::string leaf = name.substr(dot == std::string::npos ? 0 : dot + 1);
+            leaf = leaf.substr(0, leaf.find('['));
+
+            ParameterField field;
+            auto annotation = annotations.find(leaf);
+            if (annotation != annotations.end())
+                field = annotation->second;
+            field.name = name;
+            field.type = types[i];
+            field.offset = offsets[i];
+            layout.fields.push_back(field);
+        }
+
+        std::sort(layout.fields.begin(), layout.fields.end(),
+                  [](const ParameterField &a, const ParameterField &b) { return a.offset < b.offset; });
+        blocks.push_back(std::move(layout));
+    }
+}
+
+const BlockLayout* Shader::block(const std::string &name) const {
+    for (const BlockLayout &layout : blocks)
+        if (layout.name == name)
+            return &layout;
+    return nullptr;
 }
 
-void Shader::checkCompileErrors(unsigned int shader, const std::string& type) {
+void Shader::addUniform(const std::string &name, Program &program, int location, unsigned int type) {
+    int nameId = internName(name);
+    if (nameId >= (int)uniformByName.size())
+        uniformByName.resize(nameId + 1, -1);
+
+    // Already active in the other stage of a pipeline
+    int index = uniformByName[nameId];
+    if (index >= 0) {
+        UniformInfo &info = uniforms[index];
+        if (info.count < 2) {
+            info.program[info.count] = program.ID;
+            info.location[info.count] = location;
+            info.shadow[info.count] = &program.shadows[location];
+            info.count++;
+        }
+        return;
+    }
+
+    uniformByName[nameId] = (int)uniforms.size();
+    uniforms.push_back(UniformInfo{nameId, type, 1, {program.ID, 0}, {location, -1}, {&program.shadows[location], nullptr}});
+}
+
+bool Shader::checkCompileErrors(unsigned int shader, const std::string& type, const std::vector<std::string> &files) {
     int success;
     char infoLog[1024];
     if (type != "PROGRAM")
@@ -91,7 +707,7 @@ void Shader::checkCompileErrors(unsigned int shader, const std::string& type) {
         {
             glGetShaderInfoLog(shader, 1024, NULL, infoLog);
             std::cerr << "ERROR::SHADER_COMPILATION_ERROR of type: "
-            << type << "\n" << infoLog <<
+            << type << "\n" << mapSourceFiles(infoLog, files) <<
             "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
@@ -106,8 +722,5 @@ void Shader::checkCompileErrors(unsigned int shader, const std::string& type) {
             "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
-}
-
-void Shader::setVec3(const std::string &name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+    return success;
 }
@@ -2,27 +2,172 @@
 #define SHADEREVALUATOR_SHADER_H
 
 #include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstdint>
 #include <glm/glm.hpp>
 
+// Handle to a uniform name, interned once through Shader::handle() or Shader::uniform().
+// Handles are shared by all programs, each program maps them to its own location.
+struct UniformHandle {
+    int id = -1;
+    bool valid() const { return id >= 0; }
+};
+
+// Preprocessor defines injected after #version, e.g. {"FLAT_NORMALS", ""} or {"NUM_LIGHTS", "2"}.
+// Ordered so equal sets always produce the same variant key.
+using ShaderDefines = std::map<std::string, std::string>;
+
+// Member of a reflected uniform block. Annotations come from a trailing comment on the
+// member's declaration, e.g. "float albedo; // @range 0 1 @default 0.8".
+struct ParameterField {
+    std::string name;       // Without the block name, e.g. "albedo" or "lights[1].diffuse"
+    unsigned int type = 0;  // GL_FLOAT, GL_FLOAT_VEC3, ...
+    int offset = 0;         // Byte offset inside the block
+    bool annotated = false;
+    bool color = false;
+    float min = 0.0f;
+    float max = 1.0f;
+    std::vector<float> defaults;
+};
+
+struct BlockLayout {
+    std::string name;
+    int size = 0;
+    std::vector<ParameterField> fields;     // Sorted by offset
+};
+
+enum class ShaderState {
+    Idle,       // Deferred, nothing submitted yet
+    Compiling,  // Stages submitted, waiting on the driver
+    Ready,
+    Failed
+};
+
+/*
+ * Vertex + fragment shader pair. Sources are run through a small preprocessor
+ * resolving #include "file" relative to the including file. When separate
+ * shader objects are available each stage is linked as its own separable
+ * program and combined in a program pipeline, so a vertex stage used by
+ * several shaders is only compiled once.
+ *
+ * A shader built from a single compute stage is always one plain program,
+ * it needs a GL 4.3 context.
+ *
+ * */
+
 class Shader {
 public:
     // Constructors
-    Shader(const char* vsPath, const char* fsPath);
+    // A deferred shader is only compiled once beginCompile() is called, see ShaderCompiler
+    Shader(const char* vsPath, const char* fsPath, bool deferred = false, const ShaderDefines &defines = {});
+    // Compute program, compiled right away
+    explicit Shader(const char* csPath, const ShaderDefines &defines = {});
+    ~Shader();
+
+    // Owns its GL objects, a ShaderCompiler may also hold on to it while compiling
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
 
     // Methods
     void use();
+    void beginCompile();
+    bool pollCompile(bool parallel);
+    bool ready() const { return state == ShaderState::Ready; }
+
+    static bool separableSupported();
+    static std::string variantKey(const ShaderDefines &defines);
+
+    static UniformHandle handle(const std::string &name);
+    UniformHandle uniform(const std::string &name) const;
+    // True if the uniform is active, unlike the setters this never reports a missing name
+    bool active(UniformHandle handle) const;
+
+    // Layout of an active uniform block, nullptr until ready or if the block is not used
+    const BlockLayout* block(const std::string &name) const;
+
+    void setBool(UniformHandle handle, bool value) const;
+    void setInt(UniformHandle handle, int value) const;
+    void setFloat(UniformHandle handle, float value) const;
+    void setMat4(UniformHandle handle, const glm::mat4 &value) const;
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const;
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const;
+
+    // Name based setters, looked up in the reflected uniform table
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
     void setMat4(const std::string &name, glm::mat4 value) const;
     void setVec3(const std::string &name, const glm::vec3 &value) const;
-    unsigned int ID;     // Shader program ID
+    unsigned int ID;     // Shader program ID, or program pipeline ID when the stages are separable
+    ShaderState state;
+
+    // glUniform* calls made and calls skipped because the value was already uploaded
+    static unsigned long long uploadsIssued;
+    static unsigned long long uploadsSkipped;
 
 private:
-    static void checkCompileErrors(unsigned int shader, const std::string&);
-};
+    // Last value uploaded to one uniform location, compared bitwise before every upload
+    struct UniformShadow {
+        bool valid = false;
+        unsigned char bytes[sizeof(glm::mat4)];
+    };
 
+    // One program object being built, either a full program or a single separable stage.
+    // Deleted with its last owner, a shared vertex stage lives as long as any shader using it.
+    struct Program {
+        ~Program();
 
-#endif //SHADEREVALUATOR_SHADER_H
+        unsigned int ID = 0;
+        ShaderState state = ShaderState::Idle;
+        std::string cacheKey;
+        std::vector<unsigned int> stages;
+        std::vector<std::string> stageNames;
+        std::vector<std::vector<std::string>> sourceFiles;    // Per stage, source string number -> file
+        std::unordered_map<int, UniformShadow> shadows;         // Location -> last uploaded value
+    };
+
+    struct UniformInfo {
+        int nameId;
+        unsigned int type;
+        // A uniform used by both separable stages has a location in each program
+        int count;
+        unsigned int program[2];
+        int location[2];
+        UniformShadow *shadow[2];    // Owned by the program, shared by every shader using it
+    };
 
+    std::string vsPath;
+    std::string fsPath;     // Empty for a compute shader, vsPath holds the compute stage
+    ShaderDefines defines;
+    bool separable = false;
+    std::shared_ptr<Program> vertexProgram;     // Only used when separable, shared between shaders
+    std::shared_ptr<Program> program;           // Fragment stage when separable, full program otherwise
 
+    std::vector<UniformInfo> uniforms;
+    std::vector<int> uniformByName;     // Interned name id -> index in uniforms, -1 if not active
+    mutable std::unordered_set<int> missingUniforms;
+
+    std::vector<BlockLayout> blocks;
+    std::unordered_map<std::string, ParameterField> annotations;     // Member name -> annotation
+
+    static std::string injectDefines(const std::string &code, const ShaderDefines &defines);
+    static bool preprocess(const std::string &path, std::string &code, std::vector<std::string> &files);
+    static void submitProgram(Program &program, const std::vector<unsigned int> &types,
+                              const std::vector<std::string> &sources, bool separable);
+    static bool pollProgram(Program &program, bool parallel);
+    void finishCompile();
+    void reflectUniforms(Program &program);
+    void reflectBlocks(const Program &program);
+    void addUniform(const std::string &name, Program &program, int location, unsigned int type);
+    const UniformInfo* find(UniformHandle handle) const;
+    static bool changed(UniformShadow &shadow, const void *value, size_t size);
+    static bool checkCompileErrors(unsigned int shader, const std::string&,
+                                   const std::vector<std::string> &files = {});
+};
+
+
+#endif //SHADEREVALUATOR_SHADER_H
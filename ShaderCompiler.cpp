@@ -0,0 +1,66 @@
+#include "ShaderCompiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glad/glad.h>
+
+namespace {
+    bool hasExtension(const char *name) {
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (int i = 0; i < count; i++) {
+            const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+ShaderCompiler::ShaderCompiler() : parallel(false) {
+    if (hasExtension("GL_KHR_parallel_shader_compile")) {
+        parallel = true;
+#ifdef GL_KHR_parallel_shader_compile
+        // Let the driver pick as many compiler threads as it wants
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#endif
+    } else if (hasExtension("GL_ARB_parallel_shader_compile")) {
+        parallel = true;
+#ifdef GL_ARB_parallel_shader_compile
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+#endif
+    }
+}
+
+void ShaderCompiler::request(Shader &shader) {
+    if (shader.state != ShaderState::Idle)
+        return;
+
+    shader.beginCompile();
+    if (shader.state == ShaderState::Compiling)
+        pending.push_back({&shader, frame});
+}
+
+void ShaderCompiler::cancel(Shader &shader) {
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                 [&](const Pending &entry) { return entry.shader == &shader; }),
+                  pending.end());
+}
+
+void ShaderCompiler::poll() {
+    if (parallel) {
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [](const Pending &entry) { return entry.shader->pollCompile(true); }),
+                      pending.end());
+    } else {
+        // Blocks on the driver, so only the oldest program requested before this frame is finished
+        auto oldest = std::find_if(pending.begin(), pending.end(),
+                                   [this](const Pending &entry) { return entry.frame < frame; });
+        if (oldest != pending.end()) {
+            oldest->shader->pollCompile(false);
+            pending.erase(oldest);
+        }
+    }
+    frame++;
+}
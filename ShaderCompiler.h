@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include "Shader.h"
+
+/*
+ * Compilation manager for deferred shaders. Programs are submitted on request
+ * and finished later from poll(), so the frame never waits on the driver when
+ * GL_KHR_parallel_shader_compile (or the ARB variant) is available.
+ *
+ * Without the extension, finishing a program blocks until the driver has
+ * compiled and linked it, and that cannot be avoided. poll() then finishes at
+ * most one program per frame, and never in the frame that requested it. So
+ * the fallback is drawn at least once, and each program stalls a frame of
+ * its own instead of all of them stalling the same frame.
+ *
+ * */
+
+class ShaderCompiler {
+public:
+    ShaderCompiler();
+
+    // Starts compiling shader unless it has already been submitted
+    void request(Shader &shader);
+    // Finishes every pending program whose compilation has completed
+    void poll();
+    // Forgets shader, must be called before destroying a shader that may still be pending
+    void cancel(Shader &shader);
+
+    bool parallel;
+    int pendingCount() const { return (int)pending.size(); }
+
+private:
+    struct Pending {
+        Shader *shader;
+        unsigned long long frame;   // Poll count when it was requested
+    };
+    std::vector<Pending> pending;
+    unsigned long long frame = 0;
+};
@@ -0,0 +1,19 @@
+#include "ShaderVariants.h"
+
+ShaderVariants::ShaderVariants(const char *vsPath, const char *fsPath, ShaderCompiler &compiler)
+    : vsPath(vsPath), fsPath(fsPath), compiler(compiler) {}
+
+Shader& ShaderVariants::get(const ShaderDefines &defines) {
+    std::string key = Shader::variantKey(defines);
+    auto found = variants.find(key);
+    if (found != variants.end())
+        return *found->second;
+
+    return *variants.emplace(key, build(defines)).first->second;
+}
+
+std::unique_ptr<Shader> ShaderVariants::build(const ShaderDefines &defines) {
+    auto variant = std::make_unique<Shader>(vsPath.c_str(), fsPath.c_str(), true, defines);
+    compiler.request(*variant);
+    return variant;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Shader.h"
+#include "ShaderCompiler.h"
+
+/*
+ * Family of programs built from the same sources with different preprocessor
+ * defines. Variants are created on first use, handed to the ShaderCompiler and
+ * kept for the lifetime of the family, keyed by their define set.
+ *
+ * */
+
+class ShaderVariants {
+public:
+    ShaderVariants(const char* vsPath, const char* fsPath, ShaderCompiler &compiler);
+
+    // Returns the variant for defines, submitting it for compilation the first time
+    Shader& get(const ShaderDefines &defines);
+    // Submits a program with these defines that is owned by the caller instead of the family
+    std::unique_ptr<Shader> build(const ShaderDefines &defines);
+    int count() const { return (int)variants.size(); }
+
+private:
+    std::string vsPath;
+    std::string fsPath;
+    ShaderCompiler &compiler;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> variants;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <type_traits>
+
+// Binding point and name of the per-frame block declared by every shader in shaders/
+const unsigned int FRAME_DATA_BINDING = 0;
+const char* const FRAME_DATA_BLOCK = "FrameData";
+const int MAX_LIGHTS = 2;
+
+// Binding point and name of the material block, each shading model binds its own buffer here
+const unsigned int MATERIAL_BINDING = 1;
+const char* const MATERIAL_BLOCK = "Material";
+
+// std140 mirror of the FrameData block. Only vec4 and mat4 members are used so the
+// C++ layout matches std140 without explicit padding.
+struct FrameLight {
+    glm::vec4 position;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 ambient;
+};
+
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 cameraPos;
+    FrameLight lights[MAX_LIGHTS];
+};
+
+static_assert(sizeof(FrameLight) == 64, "FrameLight must match the std140 layout");
+static_assert(sizeof(FrameData) == 144 + MAX_LIGHTS * sizeof(FrameLight), "FrameData must match the std140 layout");
+
+/*
+ * Uniform buffer object attached to a fixed binding point. The contents are
+ * written once per frame and shared by every program declaring the block.
+ *
+ * */
+
+class UniformBuffer {
+public:
+    UniformBuffer(unsigned int binding, size_t size);
+    ~UniformBuffer();
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void update(const void *data) const;
+    void bind() const;
+
+    template<typename T>
+    void update(const T &data) const {
+        static_assert(!std::is_pointer<T>::value, "pass the block by reference");
+        update(static_cast<const void*>(&data));
+    }
+
+    unsigned int ID;
+    unsigned int binding;
+    size_t size;
+};
@@ -1,10 +1,32 @@
 #include <iostream>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <vector>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "Shader.h"
 #include "Camera.h"
 #include "Mesh.h"
+#include "UniformBuffer.h"
+#include "ProgramCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderVariants.h"
+#include "GpuTimer.h"
+#include "ParameterBlock.h"
+#include "MeshOptimizer.h"
+#include "Parallel.h"
+#include "MeshBuilder.h"
+#include "MeshCache.h"
+#include "MeshArchive.h"
+#include "GltfScene.h"
+#include "MaterialSweep.h"
+#include "GpuArena.h"
+#include "SceneCulling.h"
+#include "MeshTangents.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -69,14 +91,81 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(yoffset);
 }
 
+// Uniform handles are shared by every program and resolved once by name. Camera and
+// lights live in the shared FrameData block, materials in per model Material blocks.
+struct Uniforms {
+    UniformHandle model = Shader::handle("model");
+    UniformHandle interpolation = Shader::handle("interpolation");
+    UniformHandle lightCount = Shader::handle("lightCount");
+};
+
+// Widgets generated from a reflected block layout, only annotated fields are shown.
+// Returns true if a value was edited.
+bool parameterGui(const BlockLayout &layout, void *data) {
+    bool edited = false;
+    for (const ParameterField &field : layout.fields) {
+        if (!field.annotated)
+            continue;
+
+        float *value = reinterpret_cast<float*>(static_cast<unsigned char*>(data) + field.offset);
+        if (field.color && (field.type == GL_FLOAT_VEC3 || field.type == GL_FLOAT_VEC4))
+            edited |= ImGui::ColorEdit3(field.name.c_str(), value);
+        else if (field.type == GL_FLOAT)
+            edited |= ImGui::SliderFloat(field.name.c_str(), value, field.min, field.max);
+        else if (field.type == GL_FLOAT_VEC3)
+            edited |= ImGui::SliderFloat3(field.name.c_str(), value, field.min, field.max);
+        else if (field.type == GL_FLOAT_VEC4)
+            edited |= ImGui::SliderFloat4(field.name.c_str(), value, field.min, field.max);
+    }
+    return edited;
+}
+
+// Tangent space normal map of a grid of round bumps, for comparing TBN constructions
+unsigned int bumpNormalMap(int size, int bumps) {
+    const float TWO_PI = 6.28318530718f, STRENGTH = 0.6f;
+    std::vector<unsigned char> pixels(size * size * 3);
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++) {
+            float u = TWO_PI * bumps * (x + 0.5f) / size, v = TWO_PI * bumps * (y + 0.5f) / size;
+            glm::vec3 normal = glm::normalize(glm::vec3(-STRENGTH * std::cos(u) * std::sin(v),
+                                                        -STRENGTH * std::sin(u) * std::cos(v), 1.0f));
+            unsigned char *pixel = &pixels[(y * size + x) * 3];
+            for (int c = 0; c < 3; c++)
+                pixel[c] = (unsigned char)std::lround((normal[c] * 0.5f + 0.5f) * 255.0f);
+        }
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+// Everything drawn and its GL objects, released before the context is destroyed
+void runEvaluator(GLFWwindow *window);
+
 int main() {
     // Initializing render context and OpenGL
+    // GL 4.3 enables GPU culling of glTF scenes, everything else runs on 3.3
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Shader Evaluator", nullptr, nullptr);
+    GLFWwindow* window = nullptr;
+    const int versions[][2] = {{4, 3}, {3, 3}};
+    for (const auto &version : versions) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Shader Evaluator", nullptr, nullptr);
+        if (window)
+            break;
+    }
     if (window == nullptr) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -116,6 +205,17 @@ int main() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330");
 
+    runEvaluator(window);
+    GpuArena::instance().shutdown();
+
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
+    glfwTerminate();
+    return 0;
+}
+
+void runEvaluator(GLFWwindow *window) {
     ImGuiWindowFlags window_flags = 0;
     window_flags |= ImGuiWindowFlags_NoTitleBar;
     window_flags |= ImGuiWindowFlags_MenuBar;
@@ -128,45 +228,189 @@ int main() {
     static int currentShader = 0;
     // -----------
 
-    // Sphere resolution
+    // Sphere tessellation, any change in the GUI sets sphereDirty and rebuilds it in the background
+    const char* tessellations[] = {"UV sphere", "Icosphere", "Cube sphere"};
+    int tessellation = 0;
     int resolution[2] = {16, 32};
-    int prevResolution[2] = {16, 32};
+    int subdivisions = 3;
+    int cubeSize = 8;
+    int vertexFormat = (int)VertexFormat::Float;
+    bool sphereStrips = false;
+    bool optimizeSphere = false;
+    bool sphereDirty = false;
+    // Bytes of sphere geometry uploaded per frame while a rebuilt sphere is staged
+    const size_t UPLOAD_BUDGET = 8 << 20;
+
+    // Wall clock milliseconds since start
+    auto elapsedMs = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // Builds the sphere described by key, which is copied so the job can run on the builder thread.
+    // Optimized triangle lists report their statistics.
+    auto sphereJob = [](MeshKey key) -> MeshBuilder::Job {
+        return [key](OptimizeReport &report) {
+            MeshData data = key.generator == 1 ? icosphereData(key.radius, key.rings)
+                          : key.generator == 2 ? cubeSphereData(key.radius, key.rings)
+                          : sphereData(key.radius, key.rings, key.segments, key.strips);
+            // Before optimizing, so welding keeps vertices apart whose tangents differ
+            computeTangents(data);
+            if (key.optimized && data.primitive == GL_TRIANGLES) {
+                report = optimizeMesh(data);
+            } else {
+                report = OptimizeReport();
+                report.before = report.after = analyzeMesh(data);
+            }
+            return data;
+        };
+    };
+    const char* vertexFormats[] = {"Float", "Half", "Snorm16"};
+
+    // Upper bound of the buffers and CPU copies the sphere for key takes, checked against the cache
+    // budget before a build is queued. Indices are counted as 32 bits, seam vertices are left out.
+    auto sphereBytes = [](const MeshKey &key) {
+        size_t vertices, triangles;
+        if (key.generator == 1) {
+            vertices = 10 * ((size_t)1 << 2 * key.rings) + 2;
+            triangles = 20 * ((size_t)1 << 2 * key.rings);
+        } else if (key.generator == 2) {
+            vertices = 6 * (size_t)(key.rings + 1) * (key.rings + 1);
+            triangles = 12 * (size_t)key.rings * key.rings;
+        } else {
+            vertices = (size_t)(key.rings + 1) * (key.segments + 1);
+            triangles = 2 * (size_t)key.rings * key.segments;
+        }
+        return vertices * (Mesh::vertexSize(key.format) + sizeof(Vertex)) + 2 * triangles * 3 * sizeof(unsigned int);
+    };
+    bool sphereTooLarge = false;
 
-    Mesh light = generateSphere(0.05);
+    // The gizmo is never normal mapped, it goes without tangents
+    Mesh light(sphereData(0.05f));
     Mesh plane = generatePlane(100);
-    Mesh sphere = generateSphere(1, resolution[0], resolution[1]);
+    // Identifies the sphere for the current settings in the cache
+    auto sphereKey = [&]() {
+        MeshKey key;
+        key.generator = tessellation;
+        key.rings = tessellation == 1 ? subdivisions : tessellation == 2 ? cubeSize : resolution[0];
+        key.segments = tessellation == 0 ? resolution[1] : 0;
+        key.format = (VertexFormat)vertexFormat;
+        key.strips = tessellation == 0 && sphereStrips;
+        key.optimized = optimizeSphere;
+        return key;
+    };
+
+    // Every sphere built stays cached, going back to earlier settings just points at the cached mesh
+    int cacheBudgetMB = 256;
+    MeshCache sphereCache((size_t)cacheBudgetMB << 20);
+    MeshKey wantedKey = sphereKey();
+    CachedMesh *sphere;
+    {
+        auto start = std::chrono::steady_clock::now();
+        OptimizeReport report;
+        Mesh mesh(sphereJob(wantedKey)(report), wantedKey.format);
+        sphere = &sphereCache.insert(wantedKey, std::move(mesh), report, elapsedMs(start));
+    }
+
+    // Screen-size LOD draws a coarser tessellation of the sphere once its triangles get small on screen.
+    // The chain starts at the sphere's own settings and halves the resolution per level. Levels are
+    // built and uploaded like the sphere and cached under their own keys, pinned while the chain uses
+    // them. The full sphere is drawn until every level is ready. Loaded models and glTF scenes
+    // always draw at full resolution, they are uploaded without a CPU copy to decimate.
+    const int MAX_LOD_LEVELS = 6;
+    bool sphereLodEnabled = false;
+    float lodTargetPixels = 8.0f;
+    MeshLod sphereLod;
+    std::vector<MeshKey> lodKeys;               // Chain of the shown sphere, finest first
+    std::vector<CachedMesh*> lodLevels;         // Pinned cache entries of the chain, nullptr until cached
+    MeshBuilder lodBuilder;
+    MeshKey lodRequestedKey, lodStagedKey;
+    Mesh stagedLod{MeshData()};
+    OptimizeReport lodStagedReport;
+    double lodStagedMs = 0.0;
+
+    auto releaseLod = [&]() {
+        for (CachedMesh *level : lodLevels)
+            if (level)
+                level->pins--;
+        lodLevels.clear();
+        lodKeys.clear();
+        sphereLod.clear();
+        lodBuilder.cancel();
+    };
+
+    // Next coarser tessellation of key, false once it cannot get any coarser
+    auto coarserKey = [](MeshKey &key) {
+        if (key.generator == 1) {
+            if (key.rings == 0)
+                return false;
+            key.rings--;
+        } else if (key.generator == 2) {
+            if (key.rings <= 1)
+                return false;
+            key.rings /= 2;
+        } else {
+            if (key.rings <= 3 && key.segments <= 3)
+                return false;
+            key.rings = std::max(3, key.rings / 2);
+            key.segments = std::max(3, key.segments / 2);
+        }
+        return true;
+    };
+
+    // A mesh loaded from an OBJ or PLY file, shown in place of the sphere and scaled to the same size
+    char modelPath[512] = "";
+    std::unique_ptr<Mesh> model;
+    glm::mat4 modelTransform(1.0f);
+    bool showModel = false;
+    LoadStats modelStats;
+    bool modelFailed = false;
+
+    // A glTF scene takes the model's place, every draw is shaded with the PBR program of its material
+    std::unique_ptr<GltfScene> scene;
+    GltfStats sceneStats;
+    // Draws culled and drawn on the GPU when the context allows it, see SceneCulling
+    SceneCulling sceneCulling;
+    CullStats cullStats;
+    bool gpuCulling = true;
+
+    // The previous sphere is drawn until its replacement is fully uploaded into stagedSphere
+    MeshBuilder sphereBuilder;
+    MeshKey requestedKey, stagedKey;
+    Mesh stagedSphere{MeshData()};
+    OptimizeReport stagedReport;
+    double stagedMs = 0.0;
+
+    // Per-frame camera and light block shared by all programs
+    UniformBuffer frameBuffer(FRAME_DATA_BINDING, sizeof(FrameData));
+    FrameData frameData{};
+
+    const Uniforms uniforms;
+
+    // Shading model variants are compiled lazily, the fallback is drawn until they are ready
+    ShaderCompiler compiler;
+    Shader fallback("shaders/surfaceV.glsl", "shaders/fallbackF.glsl");
+
+    // Light colors are edited through the FrameData layout, defaults come from the annotations
+    const BlockLayout *frameLayout = fallback.block(FRAME_DATA_BLOCK);
+    if (frameLayout && frameLayout->size <= (int)sizeof(FrameData))
+        ParameterBlock::applyDefaults(*frameLayout, &frameData);
+    else
+        frameLayout = nullptr;
 
     // Lights
     Shader lightShader("shaders/lightVert.glsl", "shaders/lightFrag.glsl");
 
-    // Lambert
-    Shader lambert("shaders/lambertV.glsl", "shaders/lambertF.glsl");
-    glm::vec3 diffuseColor = glm::vec3(0.6f, 0.3f, 0.7f);
-    float albedo = 0.8f;
-
-    glm::vec3 light1Diffuse(1.0f, 1.0f, 1.0f);
-    glm::vec3 light2Diffuse(1.0f, 1.0f, 1.0f);
-
-    // Phong and Blinn-Phong
-    Shader phong("shaders/phongV.glsl", "shaders/phongF.glsl");
-    Shader blinnPhong("shaders/blinnPhongV.glsl", "shaders/blinnPhongF.glsl");
-
-    glm::vec3 specular = glm::vec3(1.0f, 1.0f, 1.0f);
-    glm::vec3 ambient = glm::vec3(0.2f, 0.1f, 0.3f);
-    glm::vec3 diffuse = glm::vec3(0.6f, 0.3f, 0.7f);
-    float shininess = 32;
-
-    auto specularIntensity1 = glm::vec3(1.0f);
-    auto diffuseIntensity1 = glm::vec3(1.0f);
-    auto ambientIntensity1 = glm::vec3(0.1f);
+    ShaderVariants lambert("shaders/surfaceV.glsl", "shaders/lambertF.glsl", compiler);
+    ShaderVariants phong("shaders/surfaceV.glsl", "shaders/phongF.glsl", compiler);
+    ShaderVariants blinnPhong("shaders/surfaceV.glsl", "shaders/blinnPhongF.glsl", compiler);
+    ShaderVariants orenNayar("shaders/surfaceV.glsl", "shaders/orenNayarF.glsl", compiler);
 
-    auto specularIntensity2 = glm::vec3(1.0f);
-    auto diffuseIntensity2 = glm::vec3(1.0f);
-    auto ambientIntensity2 = glm::vec3(0.1f);
+    ShaderVariants* shadingModels[] = {&lambert, &phong, &blinnPhong, &orenNayar};
+    ShaderVariants pbr("shaders/PBRvertex.glsl", "shaders/PBRfragment.glsl", compiler);
 
-    // Oren-Nayar
-    Shader orenNayar("shaders/orenNayarV.glsl", "shaders/orenNayarF.glsl");
-    float roughness = 0;
+    // Material parameters of each model, laid out from the first variant that is ready
+    ParameterBlock materials[] = {ParameterBlock(MATERIAL_BINDING), ParameterBlock(MATERIAL_BINDING),
+                                  ParameterBlock(MATERIAL_BINDING), ParameterBlock(MATERIAL_BINDING)};
 
     // In application settings
     bool showGui = true;
@@ -174,6 +418,108 @@ int main() {
     bool showLights = false;
     int renderStyle = GL_TRIANGLES;
     int smoothInterp = true;
+    int activeLights = MAX_LIGHTS;
+
+    // Shader variants. The specialized variant turns interpolation and light count into
+    // preprocessor constants, the generic one branches on uniforms per pixel.
+    bool specialize = true;
+    Shader* specializedShader = nullptr;
+    Shader* genericShader = nullptr;
+    int variantShader = -1, variantInterp = -1, variantLights = -1;
+    ShaderDefines variantDefines;
+
+    // Baking freezes the material and light colors of the specialized variant into constants.
+    // The baked program compiles in the background and is only drawn once it is ready,
+    // any edit drops it and drawing falls back to the live program in the same frame.
+    std::unique_ptr<Shader> bakedShader;
+    auto dropBake = [&]() {
+        if (bakedShader) {
+            compiler.cancel(*bakedShader);
+            bakedShader.reset();
+        }
+    };
+
+    // Benchmark mode draws the sphere repeatedly with both variants and times them on the GPU
+    const int BENCHMARK_DRAWS = 16;
+    bool benchmark = false;
+    GpuTimer genericTimer;
+    GpuTimer specializedTimer;
+
+    // Vertex format benchmark draws one sphere per format with the live shader. The variants are the
+    // shown sphere's key with another format, built and uploaded like the LOD levels and pinned in the
+    // cache while the benchmark uses them.
+    bool formatBenchmark = false;
+    CachedMesh *formatSpheres[IM_ARRAYSIZE(vertexFormats)] = {};
+    GpuTimer formatTimers[IM_ARRAYSIZE(vertexFormats)];
+    MeshBuilder formatBuilder;
+    MeshKey formatRequestedKey, formatStagedKey;
+    Mesh stagedFormat{MeshData()};
+    OptimizeReport formatStagedReport;
+    double formatStagedMs = 0.0;
+
+    auto releaseFormats = [&]() {
+        for (CachedMesh *&variant : formatSpheres) {
+            if (variant)
+                variant->pins--;
+            variant = nullptr;
+        }
+        formatBuilder.cancel();
+        for (GpuTimer &timer : formatTimers)
+            timer.reset();
+    };
+    auto formatsReady = [&]() {
+        return std::all_of(std::begin(formatSpheres), std::end(formatSpheres),
+                           [](const CachedMesh *variant) { return variant != nullptr; });
+    };
+
+    // Tangent frame benchmark shades a normal mapped sphere with the interpolated and the derivative TBN
+    const int TANGENT_SPHERE_RINGS = 128, TANGENT_SPHERE_SEGMENTS = 256;
+    bool tangentBenchmark = false;
+    std::unique_ptr<Mesh> tangentSphere;
+    unsigned int tangentNormalMap = 0;
+    GpuTimer interpolatedTbnTimer;
+    GpuTimer derivativeTbnTimer;
+
+    // Sweep grid of the shown mesh, one material member per axis, drawn as instances of a single call
+    const int MAX_SWEEP_CELLS = 32;
+    bool sweepGrid = false;
+    int sweepColumns = 8, sweepRows = 8;
+    std::string sweepFieldX, sweepFieldY;       // Swept MaterialData members, empty for none
+    MaterialSweep sweep;
+    Shader* sweepShader = nullptr;
+    int sweepVariantShader = -1;
+    ShaderDefines sweepDefines;
+    GpuTimer sweepTimer;
+    unsigned long long lastIssued = 0, lastSkipped = 0;
+
+    // Generation benchmark builds a large UV sphere on the CPU, the best of a few runs is reported.
+    // It runs at a quarter of the 4096x8192 target: that sphere has 33.5 M vertices and takes
+    // 2.4 GB with its indices. Generation is linear in the vertex count, so the throughput carries over.
+    const int GENERATION_RINGS = 2048, GENERATION_SEGMENTS = 4096, GENERATION_RUNS = 3;
+    double generationBestMs = 0.0;
+    size_t generationVertices = 0;
+
+    // Uploads the parameters of the selected shading model
+    auto applyShading = [&](Shader &shader, bool generic) {
+        shader.use();
+        if (generic) {
+            shader.setBool(uniforms.interpolation, smoothInterp);
+            shader.setInt(uniforms.lightCount, activeLights);
+        }
+
+        // The whole material is a single upload, and only after it was edited
+        ParameterBlock &material = materials[currentShader];
+        if (!material.reflected())
+            material.reflect(shader, MATERIAL_BLOCK);
+        material.bind();
+
+        // Sweep variants take the transform from their instances
+        if (shader.active(uniforms.model))
+            shader.setMat4(uniforms.model, glm::mat4(1.0f));
+    };
+
+    // Time to first frame is reported once so cold and warm program caches can be compared
+    bool firstFrame = true;
 
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = glfwGetTime();
@@ -191,147 +537,369 @@ int main() {
         // camera/view transformation
         glm::mat4 view = camera.GetViewMatrix();
 
-        glm::mat4 model = glm::mat4(1.0f);
-
-        // Rendering lights
-        lightShader.use();
-        lightShader.setMat4("projection", projection);
-        lightShader.setMat4("view", view);
-
         glm::vec4 light1Pos(-2.2f, -0.5f, 4.0f, 1.0f);
         glm::vec4 light2Pos(2.4f, 2.4f, -1.8f, 1.0f);
 
-        if (rotateLights) {
-            model = glm::rotate(model, currentFrame, glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::translate(model, glm::vec3(light1Pos));
-            light1Pos = model * light1Pos;
-            lightShader.setMat4("model", model);
-            if (showLights)
-                light.draw(lightShader, GL_TRIANGLES);
-
-            model = glm::mat4(1.0f);
-            model = glm::rotate(model, currentFrame, glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::translate(model, glm::vec3(light2Pos));
-            light2Pos = model * light2Pos;
-            lightShader.setMat4("model", model);
-            if (showLights)
-                light.draw(lightShader, GL_TRIANGLES);
+        glm::mat4 light1Model = glm::translate(glm::mat4(1.0f), glm::vec3(light1Pos));
+        glm::mat4 light2Model = glm::translate(glm::mat4(1.0f), glm::vec3(light2Pos));
 
-        } else {
-            model = glm::translate(model, glm::vec3(light1Pos));
-            lightShader.setMat4("model", model);
-            if (showLights)
-                light.draw(lightShader, GL_TRIANGLES);
-
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(light2Pos));
-            lightShader.setMat4("model", model);
-            if (showLights)
-                light.draw(lightShader, GL_TRIANGLES);
+        if (rotateLights) {
+            glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), currentFrame, glm::vec3(0.0f, 1.0f, 0.0f));
+            light1Model = rotation * light1Model;
+            light2Model = rotation * light2Model;
+            light1Pos = light1Model * light1Pos;
+            light2Pos = light2Model * light2Pos;
         }
 
-        if (resolution[0] != prevResolution[0] || resolution[1] != prevResolution[1]) {
-            sphere = generateSphere(1, resolution[0], resolution[1]);
-            prevResolution[0] = resolution[0];
-            prevResolution[1] = resolution[1];
+        // Camera and lights are uploaded once and shared by every program
+        frameData.projection = projection;
+        frameData.view = view;
+        frameData.cameraPos = glm::vec4(camera.position, 1.0f);
+        frameData.lights[0].position = light1Pos;
+        frameData.lights[1].position = light2Pos;
+        frameBuffer.update(frameData);
+
+        // Shows a different sphere, the format benchmark gathers its variants from the new settings
+        auto showSphere = [&](CachedMesh *mesh) {
+            sphere = mesh;
+            releaseFormats();
+        };
+
+        if (sphereDirty) {
+            wantedKey = sphereKey();
+            sphereTooLarge = false;
+            if (CachedMesh *cached = sphereCache.find(wantedKey)) {
+                sphereBuilder.cancel();
+                showSphere(cached);
+            } else if (sphereBytes(wantedKey) > sphereCache.budget()) {
+                // Could never stay cached, the current sphere is kept instead
+                sphereBuilder.cancel();
+                sphereTooLarge = true;
+            } else {
+                sphereBuilder.request(sphereJob(wantedKey), wantedKey.format);
+                requestedKey = wantedKey;
+            }
+            sphereDirty = false;
+        }
+        BuiltMesh built;
+        if (sphereBuilder.poll(built)) {
+            stagedKey = requestedKey;
+            stagedReport = built.report;
+            stagedMs = built.milliseconds;
+            stagedSphere.beginUpload(std::move(built.upload));
+        }
+        if (stagedSphere.uploading() && stagedSphere.continueUpload(UPLOAD_BUDGET)) {
+            // Cached even if the settings moved on meanwhile, they may come back to it
+            CachedMesh &entry = sphereCache.insert(stagedKey, std::move(stagedSphere), stagedReport, stagedMs, sphere);
+            stagedSphere = Mesh(MeshData());
+            if (stagedKey == wantedKey)
+                showSphere(&entry);
         }
 
-        if (currentShader == 0) {
-            lambert.use();
-            lambert.setBool("interpolation", smoothInterp);
-            lambert.setVec3("lights[0].position", glm::vec3(light1Pos));
-            lambert.setVec3("lights[0].color", light1Diffuse);
-            lambert.setVec3("lights[1].position", glm::vec3(light2Pos));
-            lambert.setVec3("lights[1].color", light2Diffuse);
-
-            lambert.setVec3("material.color", diffuseColor);
-            lambert.setFloat("material.albedo", albedo);
-
-            model = glm::mat4(1.0f);
-
-            lambert.setMat4("projection", projection);
-            lambert.setMat4("view", view);
-            lambert.setMat4("model", model);
-
-            sphere.draw(lambert, renderStyle);
-
-
-        } else if (currentShader == 1) {
-            phong.use();
-            phong.setBool("interpolation", smoothInterp);
-
-            phong.setVec3("lights[0].position", light1Pos);
-            phong.setVec3("lights[0].specularIntensity", specularIntensity1);
-            phong.setVec3("lights[0].diffuseIntensity", light1Diffuse);
-            phong.setVec3("lights[0].ambientIntensity", ambientIntensity1);
-
-            phong.setVec3("lights[1].position", light2Pos);
-            phong.setVec3("lights[1].specularIntensity", specularIntensity2);
-            phong.setVec3("lights[1].diffuseIntensity", light2Diffuse);
-            phong.setVec3("lights[1].ambientIntensity", ambientIntensity2);
-
-            phong.setVec3("material.specularReflection", specular);
-            phong.setVec3("material.diffuseReflection", diffuse);
-            phong.setVec3("material.ambientReflection", ambient);
-            phong.setFloat("material.shininess", shininess);
-
-            model = glm::mat4(1.0f);
-
-            phong.setVec3("CameraPos", camera.position);
-            phong.setMat4("projection", projection);
-            phong.setMat4("view", view);
-            phong.setMat4("model", model);
-
-            sphere.draw(phong, renderStyle);
-
-        } else if (currentShader == 2) {
-            blinnPhong.use();
-            blinnPhong.setBool("interpolation", smoothInterp);
-
-            blinnPhong.setVec3("lights[0].position", light1Pos);
-            blinnPhong.setVec3("lights[0].specularIntensity", specularIntensity1);
-            blinnPhong.setVec3("lights[0].diffuseIntensity", light1Diffuse);
-            blinnPhong.setVec3("lights[0].ambientIntensity", ambientIntensity1);
-
-            blinnPhong.setVec3("lights[1].position", light2Pos);
-            blinnPhong.setVec3("lights[1].specularIntensity", specularIntensity2);
-            blinnPhong.setVec3("lights[1].diffuseIntensity", light2Diffuse);
-            blinnPhong.setVec3("lights[1].ambientIntensity", ambientIntensity2);
+        // The chain follows the shown sphere, its missing levels are built one at a time
+        if (sphereLodEnabled) {
+            if (lodKeys.empty() || !(lodKeys[0] == sphere->key)) {
+                releaseLod();
+                MeshKey key = sphere->key;
+                for (int level = 0; level < MAX_LOD_LEVELS; level++) {
+                    lodKeys.push_back(key);
+                    if (!coarserKey(key))
+                        break;
+                }
+                lodLevels.assign(lodKeys.size(), nullptr);
+            }
+            if (!sphereLod.levelCount()) {
+                // Levels are pinned as soon as they are cached, building the rest cannot evict them
+                int missing = -1;
+                for (size_t level = 0; level < lodKeys.size(); level++) {
+                    if (!lodLevels[level] && sphereCache.contains(lodKeys[level])) {
+                        lodLevels[level] = sphereCache.find(lodKeys[level]);
+                        lodLevels[level]->pins++;
+                    }
+                    if (!lodLevels[level] && missing < 0)
+                        missing = (int)level;
+                }
+                if (missing < 0) {
+                    for (CachedMesh *level : lodLevels)
+                        sphereLod.addLevel(level->mesh);
+                } else if (!lodBuilder.busy() && !stagedLod.uploading()) {
+                    lodBuilder.request(sphereJob(lodKeys[missing]), lodKeys[missing].format);
+                    lodRequestedKey = lodKeys[missing];
+                }
+            }
+        }
+        if (lodBuilder.poll(built)) {
+            lodStagedKey = lodRequestedKey;
+            lodStagedReport = built.report;
+            lodStagedMs = built.milliseconds;
+            stagedLod.beginUpload(std::move(built.upload));
+        }
+        // The shown sphere's upload goes first, all share one budget per frame
+        if (stagedLod.uploading() && !stagedSphere.uploading() && stagedLod.continueUpload(UPLOAD_BUDGET)) {
+            // A level of the current chain is pinned by the insert itself, so later inserts cannot evict it
+            auto level = std::find(lodKeys.begin(), lodKeys.end(), lodStagedKey);
+            bool pin = level != lodKeys.end() && !lodLevels[level - lodKeys.begin()];
+            CachedMesh &entry = sphereCache.insert(lodStagedKey, std::move(stagedLod), lodStagedReport, lodStagedMs,
+                                                   sphere, pin);
+            if (pin)
+                lodLevels[level - lodKeys.begin()] = &entry;
+            stagedLod = Mesh(MeshData());
+        }
 
-            blinnPhong.setVec3("material.specularReflection", specular);
-            blinnPhong.setVec3("material.diffuseReflection", diffuse);
-            blinnPhong.setVec3("material.ambientReflection", ambient);
-            blinnPhong.setFloat("material.shininess", shininess);
+        // Format variants of the shown sphere, taken from the cache or built one at a time
+        if (formatBenchmark) {
+            int missing = -1;
+            for (int format = 0; format < IM_ARRAYSIZE(vertexFormats); format++) {
+                MeshKey key = sphere->key;
+                key.format = (VertexFormat)format;
+                if (!formatSpheres[format] && sphereCache.contains(key)) {
+                    formatSpheres[format] = sphereCache.find(key);
+                    formatSpheres[format]->pins++;
+                }
+                if (!formatSpheres[format] && missing < 0)
+                    missing = format;
+            }
+            if (missing >= 0 && !formatBuilder.busy() && !stagedFormat.uploading()) {
+                formatRequestedKey = sphere->key;
+                formatRequestedKey.format = (VertexFormat)missing;
+                formatBuilder.request(sphereJob(formatRequestedKey), formatRequestedKey.format);
+            }
+        }
+        if (formatBuilder.poll(built)) {
+            formatStagedKey = formatRequestedKey;
+            formatStagedReport = built.report;
+            formatStagedMs = built.milliseconds;
+            stagedFormat.beginUpload(std::move(built.upload));
+        }
+        if (stagedFormat.uploading() && !stagedSphere.uploading() && !stagedLod.uploading() &&
+            stagedFormat.continueUpload(UPLOAD_BUDGET)) {
+            MeshKey shownKey = sphere->key;
+            shownKey.format = formatStagedKey.format;
+            int format = (int)formatStagedKey.format;
+            bool pin = formatBenchmark && formatStagedKey == shownKey && !formatSpheres[format];
+            CachedMesh &entry = sphereCache.insert(formatStagedKey, std::move(stagedFormat), formatStagedReport,
+                                                   formatStagedMs, sphere, pin);
+            if (pin)
+                formatSpheres[format] = &entry;
+            stagedFormat = Mesh(MeshData());
+        }
 
-            model = glm::mat4(1.0f);
+        bool showScene = showModel && scene;
+        glm::mat4 sceneTransform = showModel && (model || scene) ? modelTransform : glm::mat4(1.0f);
+
+        // Projected size of the sphere from its transformed center and the current framebuffer height
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        bool lodReady = sphereLodEnabled && sphereLod.levelCount();
+        glm::vec3 sphereCenter(sceneTransform * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        float sphereScale = std::max({glm::length(glm::vec3(sceneTransform[0])), glm::length(glm::vec3(sceneTransform[1])),
+                                      glm::length(glm::vec3(sceneTransform[2]))});
+        float sphereScreenRadius = MeshLod::screenRadius(sphereScale * (lodReady ? sphereLod.boundingRadius() : sphere->key.radius),
+                                                         glm::length(camera.position - sphereCenter),
+                                                         glm::radians(camera.zoom), (float)framebufferHeight);
+        if (lodReady)
+            sphereLod.select(sphereScreenRadius, lodTargetPixels);
+        const Mesh &sphereMesh = lodReady ? sphereLod.level(sphereLod.currentLevel()) : sphere->mesh;
+        const Mesh &sceneMesh = showModel && model ? *model : sphereMesh;
+
+        // Pick the variants from the GUI state, the lookup only runs when that state changes
+        if (variantShader != currentShader || variantInterp != smoothInterp || variantLights != activeLights) {
+            variantDefines = {{smoothInterp ? "SMOOTH_NORMALS" : "FLAT_NORMALS", ""},
+                              {"NUM_LIGHTS", std::to_string(activeLights)}};
+            specializedShader = &shadingModels[currentShader]->get(variantDefines);
+            genericShader = nullptr;
+            dropBake();
+            genericTimer.reset();
+            specializedTimer.reset();
+
+            variantShader = currentShader;
+            variantInterp = smoothInterp;
+            variantLights = activeLights;
+        }
+        if (!genericShader && (!specialize || benchmark))
+            genericShader = &shadingModels[currentShader]->get({});
+
+        // The sweep variant is the specialized one with the swept members read from the instances
+        ParameterBlock &sweepMaterial = materials[currentShader];
+        bool sweeping = sweepGrid && !showScene && sweepMaterial.reflected();
+        if (sweeping) {
+            auto sweepAxis = [&](const std::string &name) {
+                for (const ParameterField &field : sweepMaterial.layout.fields) {
+                    if (!MaterialSweep::sweepable(field))
+                        continue;
+                    SweepAxis axis = MaterialSweep::axis(field, sweepMaterial.data.data());
+                    if (axis.field == name)
+                        return axis;
+                }
+                return SweepAxis();
+            };
+            SweepAxis axisX = sweepAxis(sweepFieldX), axisY = sweepAxis(sweepFieldY);
+
+            ShaderDefines defines = MaterialSweep::defines(axisX, axisY);
+            defines.insert(variantDefines.begin(), variantDefines.end());
+            if (sweepVariantShader != currentShader || defines != sweepDefines) {
+                sweepShader = &shadingModels[currentShader]->get(defines);
+                sweepDefines = defines;
+                sweepVariantShader = currentShader;
+                sweepTimer.reset();
+            }
 
-            blinnPhong.setVec3("CameraPos", camera.position);
-            blinnPhong.setMat4("projection", projection);
-            blinnPhong.setMat4("view", view);
-            blinnPhong.setMat4("model", model);
+            float radius = showModel && model ? 1.0f : lodReady ? sphereLod.boundingRadius() : sphere->key.radius;
+            sweep.update(sweepColumns, sweepRows, radius, sceneTransform, axisX, axisY);
+        }
+        compiler.poll();
 
-            sphere.draw(blinnPhong, renderStyle);
-        } else if (currentShader == 3) {
-            orenNayar.use();
-            orenNayar.setBool("interpolation", smoothInterp);
+        bool baked = bakedShader && bakedShader->ready();
+        Shader &shader = baked ? *bakedShader : specialize ? *specializedShader : *genericShader;
 
-            orenNayar.setVec3("lights[0].position", light1Pos);
-            orenNayar.setVec3("lights[0].intensity", light1Diffuse);
+        if (!shader.ready()) {
+            if (!showScene) {
+                fallback.use();
+                fallback.setMat4(uniforms.model, sceneTransform);
+                sceneMesh.draw(fallback, renderStyle);
+            }
+        } else {
+            if (benchmark && genericShader->ready() && specializedShader->ready()) {
+                // Depth testing is off so every draw shades all of its fragments
+                glDisable(GL_DEPTH_TEST);
+
+                applyShading(*genericShader, true);
+                genericTimer.begin();
+                for (int i = 0; i < BENCHMARK_DRAWS; i++)
+                    sphere->mesh.draw(*genericShader, GL_TRIANGLES);
+                genericTimer.end();
+
+                applyShading(*specializedShader, false);
+                specializedTimer.begin();
+                for (int i = 0; i < BENCHMARK_DRAWS; i++)
+                    sphere->mesh.draw(*specializedShader, GL_TRIANGLES);
+                specializedTimer.end();
+
+                glEnable(GL_DEPTH_TEST);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
 
-            orenNayar.setVec3("lights[1].position", light2Pos);
-            orenNayar.setVec3("lights[1].intensity", light2Diffuse);
+            if (formatBenchmark && formatsReady()) {
+                glDisable(GL_DEPTH_TEST);
+                applyShading(shader, !specialize && !baked);
+                for (int format = 0; format < IM_ARRAYSIZE(vertexFormats); format++) {
+                    formatTimers[format].begin();
+                    for (int i = 0; i < BENCHMARK_DRAWS; i++)
+                        formatSpheres[format]->mesh.draw(shader, GL_TRIANGLES);
+                    formatTimers[format].end();
+                }
+                glEnable(GL_DEPTH_TEST);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
 
-            orenNayar.setFloat("material.albedo", albedo);
-            orenNayar.setFloat("material.roughness", roughness);
+            if (tangentBenchmark) {
+                if (!tangentSphere) {
+                    tangentSphere = std::make_unique<Mesh>(generateSphere(1, TANGENT_SPHERE_RINGS, TANGENT_SPHERE_SEGMENTS));
+                    tangentNormalMap = bumpNormalMap(512, 16);
+                }
+                ShaderDefines tbnDefines = {{"NORMAL_MAP", ""}, {"NUM_LIGHTS", std::to_string(activeLights)}};
+                Shader &interpolated = pbr.get(tbnDefines);
+                tbnDefines["DERIVATIVE_TBN"] = "";
+                Shader &derivative = pbr.get(tbnDefines);
+
+                if (interpolated.ready() && derivative.ready()) {
+                    static const UniformHandle albedoHandle = Shader::handle("material.albedo");
+                    static const UniformHandle metallicHandle = Shader::handle("material.metallic");
+                    static const UniformHandle roughnessHandle = Shader::handle("material.roughness");
+                    static const UniformHandle normalMapHandle = Shader::handle("normalMap");
+
+                    glDisable(GL_DEPTH_TEST);
+                    glActiveTexture(GL_TEXTURE2);
+                    glBindTexture(GL_TEXTURE_2D, tangentNormalMap);
+                    glActiveTexture(GL_TEXTURE0);
+                    auto timeTbn = [&](Shader &program, GpuTimer &timer) {
+                        program.use();
+                        program.setVec3(albedoHandle, glm::vec3(0.8f));
+                        program.setFloat(metallicHandle, 0.0f);
+                        program.setFloat(roughnessHandle, 0.5f);
+                        program.setInt(normalMapHandle, 2);
+                        program.setMat4(uniforms.model, glm::mat4(1.0f));
+                        timer.begin();
+                        for (int i = 0; i < BENCHMARK_DRAWS; i++)
+                            tangentSphere->draw(program, GL_TRIANGLES);
+                        timer.end();
+                    };
+                    timeTbn(interpolated, interpolatedTbnTimer);
+                    timeTbn(derivative, derivativeTbnTimer);
+                    glEnable(GL_DEPTH_TEST);
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                }
+            }
 
-            model = glm::mat4(1.0f);
+            if (sweeping && sweepShader->ready()) {
+                applyShading(*sweepShader, false);
+                sweepTimer.begin();
+                sweep.draw(sceneMesh, *sweepShader, renderStyle);
+                sweepTimer.end();
+            } else if (!showScene) {
+                applyShading(shader, !specialize && !baked);
+                shader.setMat4(uniforms.model, sceneTransform);
+                sceneMesh.draw(shader, renderStyle);
+            }
+        }
 
-            orenNayar.setVec3("CameraPos", camera.position);
-            orenNayar.setMat4("projection", projection);
-            orenNayar.setMat4("view", view);
-            orenNayar.setMat4("model", model);
+        if (showScene) {
+            auto sceneProgram = [&](const GltfMaterial &material, bool indirect) -> Shader& {
+                ShaderDefines defines = scene->defines(material);
+                defines["NUM_LIGHTS"] = std::to_string(activeLights);
+                if (indirect)
+                    defines["INDIRECT_DRAW"] = "";
+                return pbr.get(defines);
+            };
+            auto drawItem = [&](const GltfDraw &item) {
+                const GltfMaterial &material = scene->material(item.material);
+                Shader &program = sceneProgram(material, false);
+                Shader &drawShader = program.ready() ? program : fallback;
+                drawShader.use();
+                if (program.ready())
+                    scene->applyMaterial(program, material);
+                drawShader.setMat4(uniforms.model, sceneTransform * item.transform);
+                scene->meshes[item.mesh].draw(drawShader, renderStyle);
+            };
+
+            glm::mat4 viewProjection = projection * view;
+            if (gpuCulling && sceneCulling.ready()) {
+                sceneCulling.cull(sceneTransform, viewProjection);
+                cullStats = sceneCulling.stats();
+                for (size_t batch = 0; batch < sceneCulling.batches().size(); batch++) {
+                    const CullBatch &cullBatch = sceneCulling.batches()[batch];
+                    const GltfMaterial &material = scene->material(cullBatch.material);
+                    Shader &program = sceneProgram(material, true);
+                    if (program.ready()) {
+                        program.use();
+                        scene->applyMaterial(program, material);
+                        sceneCulling.draw(batch, *scene, program, renderStyle);
+                    } else {
+                        // Uncompiled variants draw their batch unculled with the fallback
+                        for (size_t index : cullBatch.draws)
+                            drawItem(scene->draws[index]);
+                    }
+                }
+            } else {
+                cullStats = CullStats();
+                cullStats.objects = scene->draws.size();
+                for (const GltfDraw &item : scene->draws) {
+                    if (!SceneCulling::visible(sceneTransform * item.transform, viewProjection, item.boundsMin, item.boundsMax))
+                        continue;
+                    drawItem(item);
+                    cullStats.visible++;
+                    cullStats.drawCalls++;
+                }
+            }
+        }
 
-            sphere.draw(orenNayar, renderStyle);
+        // Rendering lights
+        if (showLights) {
+            lightShader.use();
+            lightShader.setMat4(uniforms.model, light1Model);
+            light.draw(lightShader, GL_TRIANGLES);
+            lightShader.setMat4(uniforms.model, light2Model);
+            light.draw(lightShader, GL_TRIANGLES);
         }
 
         // Start the Dear ImGui frame
@@ -347,10 +915,82 @@ int main() {
             ImGui::Begin("Shading", &showGui, window_flags);
             ImGui::Text("SHADING MODEL:");
             ImGui::Combo("", &currentShader, items, IM_ARRAYSIZE(items));
+            if (shader.state == ShaderState::Failed)
+                ImGui::TextDisabled("Compilation failed, see console");
+            else if (!shader.ready())
+                ImGui::TextDisabled("Compiling...");
             ImGui::Separator();
             ImGui::Text("SCENE SETTINGS:");
-            ImGui::Text("Sphere resolution:");
-            ImGui::DragInt2("Rings, Segments", resolution, 1, 3, 128);
+            ImGui::Text("Sphere tessellation:");
+            sphereDirty |= ImGui::Combo("Tessellation", &tessellation, tessellations, IM_ARRAYSIZE(tessellations));
+            if (tessellation == 1)
+                sphereDirty |= ImGui::SliderInt("Subdivisions", &subdivisions, 0, 7);
+            else if (tessellation == 2)
+                sphereDirty |= ImGui::SliderInt("Cells per face edge", &cubeSize, 1, 128);
+            else
+                sphereDirty |= ImGui::DragInt2("Rings, Segments", resolution, 1, 3, 2048);
+            if (sphereTooLarge)
+                ImGui::TextDisabled("%.0f MB needed, over the cache budget", sphereBytes(wantedKey) / (1024.0 * 1024.0));
+            ImGui::TextDisabled("%zu triangles, %zu vertices, built in %.2f ms",
+                                sphere->mesh.triangleCount(), sphere->mesh.vertices.size(), sphere->milliseconds);
+            if (sphereBuilder.busy() || stagedSphere.uploading())
+                ImGui::TextDisabled(stagedSphere.uploading() ? "Uploading..." : "Building...");
+            if (sphereBuilder.dropped)
+                ImGui::TextDisabled("%d stale rebuilds dropped", sphereBuilder.dropped);
+            if (ImGui::SliderInt("Cache budget (MB)", &cacheBudgetMB, 0, 2048)) {
+                sphereCache.setBudget((size_t)cacheBudgetMB << 20, sphere);
+                sphereDirty |= sphereTooLarge;
+            }
+            ImGui::TextDisabled("Cache: %zu meshes, %.1f MB, %llu hits, %llu misses, %llu evicted", sphereCache.size(),
+                                sphereCache.bytes() / (1024.0 * 1024.0), sphereCache.hits, sphereCache.misses, sphereCache.evictions);
+            ImGui::TextDisabled("Mesh buffers: %d allocations, %.1f KB", Mesh::allocations, Mesh::gpuBytes / 1024.0);
+            const char *poolNames[] = {"Vertex", "Index"};
+            for (GpuPool pool : {GpuPool::Vertex, GpuPool::Index}) {
+                GpuArenaStats arena = GpuArena::instance().stats(pool);
+                ImGui::TextDisabled("%s arena: %zu blocks, %.1f / %.1f MB used, %.1f MB retired, %zu free ranges, %.0f%% fragmented",
+                                    poolNames[(int)pool], arena.blocks, arena.usedBytes / (1024.0 * 1024.0),
+                                    arena.reservedBytes / (1024.0 * 1024.0), arena.retiredBytes / (1024.0 * 1024.0),
+                                    arena.freeRanges, arena.fragmentation() * 100.0f);
+            }
+            ImGui::TextDisabled("Shared vertex arrays: %zu for %zu vertex ranges", GpuArena::instance().vertexArrayCount(),
+                                GpuArena::instance().stats(GpuPool::Vertex).liveRanges);
+            ImGui::Text("Vertex format:"); ImGui::SameLine();
+            for (int format = 0; format < IM_ARRAYSIZE(vertexFormats); format++) {
+                if (format)
+                    ImGui::SameLine();
+                sphereDirty |= ImGui::RadioButton(vertexFormats[format], &vertexFormat, format);
+            }
+            if (tessellation == 0) {
+                sphereDirty |= ImGui::Checkbox("Triangle strips", &sphereStrips);
+                ImGui::SameLine();
+            }
+            ImGui::TextDisabled("%zu-bit indices, %.1f KB", sphere->mesh.indexSize() * 8, sphere->mesh.indexBytes() / 1024.0);
+            sphereDirty |= ImGui::Checkbox("Optimize mesh", &optimizeSphere);
+            if (sphere->mesh.primitiveType() == GL_TRIANGLES) {
+                const MeshStats &before = sphere->report.before, &after = sphere->report.after;
+                ImGui::TextDisabled("Before: %zu tris, ACMR %.3f, ATVR %.3f", before.triangles, before.acmr, before.atvr);
+                if (optimizeSphere) {
+                    ImGui::TextDisabled("After:  %zu tris, ACMR %.3f, ATVR %.3f", after.triangles, after.acmr, after.atvr);
+                    ImGui::TextDisabled("%zu vertices welded, %zu degenerate triangles removed",
+                                        sphere->report.welded, sphere->report.degenerate);
+                }
+            }
+            if (ImGui::Checkbox("Screen-size LOD", &sphereLodEnabled) && !sphereLodEnabled)
+                releaseLod();
+            if (sphereLodEnabled && showModel && (model || scene))
+                ImGui::TextDisabled("Only the sphere has LOD levels, models draw at full resolution");
+            else if (sphereLodEnabled && !sphereLod.levelCount())
+                ImGui::TextDisabled("Building LOD levels...");
+            else if (sphereLodEnabled) {
+                ImGui::SameLine();
+                ImGui::SliderFloat("Triangle size (px)", &lodTargetPixels, 1.0f, 64.0f);
+                int level = sphereLod.currentLevel();
+                size_t full = sphereLod.triangles(0), drawn = sphereLod.triangles(level);
+                ImGui::TextDisabled("LOD %d of %zu: %zu of %zu triangles, %.0f%% saved", level, sphereLod.levelCount(),
+                                    drawn, full, full ? 100.0 * (full - drawn) / full : 0.0);
+                ImGui::TextDisabled("Projected radius %.0f px, triangles %.1f px", sphereScreenRadius,
+                                    sphereLod.triangleSize(level, sphereScreenRadius));
+            }
             ImGui::Text("Interpolation:"); ImGui::SameLine();
             ImGui::RadioButton("Flatt", &smoothInterp, 0); ImGui::SameLine();
             ImGui::RadioButton("Smooth", &smoothInterp, 1);
@@ -360,35 +1000,215 @@ int main() {
             ImGui::RadioButton("Points", &renderStyle, GL_POINTS);
             ImGui::Checkbox("Rotate lights", &rotateLights); ImGui::SameLine();
             ImGui::Checkbox("Show lights", &showLights);
+            ImGui::SliderInt("Active lights", &activeLights, 1, MAX_LIGHTS);
 
             ImGui::Separator();
-            ImGui::Text("SHADER SETTINGS:");
-            if (currentShader == 0 || currentShader == 3) {
-                ImGui::ColorEdit3("Light 1", glm::value_ptr(light1Diffuse));
-                ImGui::ColorEdit3("Light 2", glm::value_ptr(light2Diffuse));
-            } else if (currentShader == 1 || currentShader == 2) {
-                ImGui::ColorEdit3("Light 1 diffuse", glm::value_ptr(light1Diffuse));
-                ImGui::ColorEdit3("Light 1 specular", glm::value_ptr(specularIntensity1));
-                ImGui::ColorEdit3("Light 1 ambient", glm::value_ptr(ambientIntensity1));
-                ImGui::Text("");
-
-                ImGui::ColorEdit3("Light 2 diffuse", glm::value_ptr(light2Diffuse));
-                ImGui::ColorEdit3("Light 2 specular", glm::value_ptr(specularIntensity2));
-                ImGui::ColorEdit3("Light 2 ambient", glm::value_ptr(ambientIntensity2));
+            ImGui::Text("MODEL:");
+            ImGui::InputText("OBJ, PLY or glTF file", modelPath, IM_ARRAYSIZE(modelPath));
+            if (ImGui::Button("Load")) {
+                std::string path = modelPath;
+                auto endsWith = [&](const std::string &suffix) {
+                    return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+                };
+                glm::vec3 boundsMin, boundsMax;
+                if (endsWith(".gltf") || endsWith(".glb")) {
+                    auto loaded = std::make_unique<GltfScene>();
+                    modelFailed = !loaded->load(path, (VertexFormat)vertexFormat, &sceneStats);
+                    if (!modelFailed) {
+                        scene = std::move(loaded);
+                        sceneCulling.build(*scene);
+                        model.reset();
+                        boundsMin = sceneStats.boundsMin;
+                        boundsMax = sceneStats.boundsMax;
+                    }
+                } else {
+                    auto loaded = std::make_unique<Mesh>(MeshData(), (VertexFormat)vertexFormat);
+                    modelFailed = !MeshArchive::import(path, (VertexFormat)vertexFormat, *loaded, &modelStats);
+                    if (!modelFailed) {
+                        model = std::move(loaded);
+                        scene.reset();
+                        sceneCulling.clear();
+                        boundsMin = modelStats.boundsMin;
+                        boundsMax = modelStats.boundsMax;
+                    }
+                }
+                if (!modelFailed) {
+                    showModel = true;
+
+                    // Centered and scaled to the sphere's size from the bounds
+                    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+                    float extent = glm::length(boundsMax - boundsMin) * 0.5f;
+                    modelTransform = glm::scale(glm::mat4(1.0f), glm::vec3(extent > 0.0f ? 1.0f / extent : 1.0f));
+                    modelTransform = glm::translate(modelTransform, -center);
+                }
+            }
+            ImGui::SameLine();
+            ImGui::Checkbox("Show model", &showModel);
+            if (modelFailed) {
+                ImGui::TextDisabled("Loading failed, see console");
+            } else if (scene) {
+                ImGui::TextDisabled("%zu draws, %zu primitives (%zu direct, %zu skipped), %zu triangles, %zu textures",
+                                    scene->draws.size(), sceneStats.primitives, sceneStats.directPrimitives,
+                                    sceneStats.skippedPrimitives, sceneStats.triangles, sceneStats.textures);
+                ImGui::TextDisabled("Imported %.1f MB in %.1f ms, peak %.1f MB CPU, %.1f MB GPU",
+                                    sceneStats.fileBytes / (1024.0 * 1024.0), sceneStats.milliseconds,
+                                    sceneStats.peakBytes / (1024.0 * 1024.0), sceneStats.gpuBytes / (1024.0 * 1024.0));
+                if (SceneCulling::supported())
+                    ImGui::Checkbox("GPU culling", &gpuCulling);
+                else
+                    ImGui::TextDisabled("GPU culling needs OpenGL 4.3");
+                ImGui::TextDisabled("%s: %zu visible, %zu culled, %zu %s", cullStats.gpu ? "GPU" : "CPU",
+                                    cullStats.visible, cullStats.culled(), cullStats.drawCalls,
+                                    cullStats.gpu ? "multi-draws" : "draws");
+            } else if (model) {
+                ImGui::TextDisabled("%zu vertices, %zu triangles, %.1f MB in %.1f ms", modelStats.vertices,
+                                    modelStats.triangles, modelStats.bytes / (1024.0 * 1024.0), modelStats.milliseconds);
+                if (modelStats.archived)
+                    ImGui::TextDisabled("%.1f MB/s from the mesh archive, %.2f M triangles/s", modelStats.megabytesPerSecond(),
+                                        modelStats.trianglesPerSecond() / 1e6);
+                else
+                    ImGui::TextDisabled("%.1f MB/s, %.2f M triangles/s, %zu chunks on %u threads", modelStats.megabytesPerSecond(),
+                                        modelStats.trianglesPerSecond() / 1e6, modelStats.chunks, workerCount());
+                ImGui::TextDisabled("Mesh archives: %d hits, %d misses", MeshArchive::hits, MeshArchive::misses);
+            }
+
+            ImGui::Separator();
+            ImGui::Text("PERFORMANCE:");
+            ImGui::Checkbox("Specialized variants", &specialize); ImGui::SameLine();
+            if (ImGui::Checkbox("Benchmark", &benchmark)) {
+                genericTimer.reset();
+                specializedTimer.reset();
+            }
+            if (benchmark) {
+                ImGui::Text("Uniform branch: %.3f ms", genericTimer.milliseconds());
+                ImGui::Text("Specialized:    %.3f ms", specializedTimer.milliseconds());
+                ImGui::TextDisabled("GPU time for %d full sphere draws", BENCHMARK_DRAWS);
+            }
+            if (ImGui::Checkbox("Vertex formats", &formatBenchmark))
+                releaseFormats();
+            if (formatBenchmark && !formatsReady())
+                ImGui::TextDisabled("Building format variants...");
+            else if (formatBenchmark) {
+                for (int format = 0; format < IM_ARRAYSIZE(vertexFormats); format++)
+                    ImGui::Text("%-8s %2zu B/vertex  %.3f ms", vertexFormats[format],
+                                Mesh::vertexSize((VertexFormat)format), formatTimers[format].milliseconds());
+                ImGui::TextDisabled("GPU time for %d sphere draws per format", BENCHMARK_DRAWS);
+            }
+            if (ImGui::Checkbox("Tangent frames", &tangentBenchmark)) {
+                interpolatedTbnTimer.reset();
+                derivativeTbnTimer.reset();
             }
+            if (tangentBenchmark) {
+                ImGui::Text("Vertex tangents: %.3f ms", interpolatedTbnTimer.milliseconds());
+                ImGui::Text("Derivatives:     %.3f ms", derivativeTbnTimer.milliseconds());
+                ImGui::TextDisabled("GPU time for %d normal mapped sphere draws", BENCHMARK_DRAWS);
+            }
+            if (ImGui::Button("Sphere generation")) {
+                generationBestMs = 0.0;
+                for (int run = 0; run < GENERATION_RUNS; run++) {
+                    auto start = std::chrono::steady_clock::now();
+                    MeshData data = sphereData(1, GENERATION_RINGS, GENERATION_SEGMENTS);
+                    double ms = elapsedMs(start);
+                    generationVertices = data.vertices.size();
+                    if (run == 0 || ms < generationBestMs)
+                        generationBestMs = ms;
+                }
+            }
+            if (generationVertices) {
+                ImGui::SameLine();
+                ImGui::Text("%.2f ms, %.1f M vertices/s", generationBestMs,
+                            generationVertices / (generationBestMs * 1000.0));
+                ImGui::TextDisabled("Best of %d runs at %dx%d on %u threads, 4096x8192 takes about %.0f ms",
+                                    GENERATION_RUNS, GENERATION_RINGS, GENERATION_SEGMENTS, workerCount(),
+                                    generationBestMs * (4096.0 * 8192.0) / generationVertices);
+            }
+            ImGui::Text("Uniform uploads: %llu issued, %llu skipped",
+                        Shader::uploadsIssued - lastIssued, Shader::uploadsSkipped - lastSkipped);
+            ImGui::TextDisabled("Per frame, identical values are not uploaded again");
+            lastIssued = Shader::uploadsIssued;
+            lastSkipped = Shader::uploadsSkipped;
+
             ImGui::Separator();
-            if (currentShader == 0) {
-                ImGui::SliderFloat("Albedo", &albedo, 0.0f, 1.0f);
-                ImGui::ColorEdit3("Diffuse color", glm::value_ptr(diffuseColor));
-            } else if (currentShader == 1 || currentShader == 2) {
-                ImGui::ColorEdit3("Diffuse color", glm::value_ptr(diffuse));
-                ImGui::ColorEdit3("Specular color", glm::value_ptr(specular));
-                ImGui::ColorEdit3("Ambient color", glm::value_ptr(ambient));
-                ImGui::SliderFloat("Shininess", &shininess, 1.0f, 128.0f);
-            } else if (currentShader == 3) {
-                ImGui::SliderFloat("Albedo", &albedo, 0.0f, 1.0f);
-                ImGui::SliderFloat("Roughness", &roughness, 0.0f, 1.0f);
+            ImGui::Text("SHADER SETTINGS:");
+            // Light colors are part of FrameData, which is uploaded every frame anyway
+            if (frameLayout && parameterGui(*frameLayout, &frameData))
+                dropBake();
+            ImGui::Separator();
+            ParameterBlock &material = materials[currentShader];
+            if (material.reflected() && parameterGui(material.layout, material.data.data())) {
+                material.dirty = true;
+                dropBake();
+            }
+            ImGui::Text("Material uploads: %d", ParameterBlock::uploads);
+
+            // Axes pick among the floats and colors of the current material
+            auto sweepCombo = [&](const char *label, std::string &field) {
+                if (!ImGui::BeginCombo(label, field.empty() ? "None" : field.c_str()))
+                    return;
+                if (ImGui::Selectable("None", field.empty()))
+                    field.clear();
+                for (const ParameterField &candidate : material.layout.fields) {
+                    if (!MaterialSweep::sweepable(candidate))
+                        continue;
+                    std::string name = MaterialSweep::axis(candidate, material.data.data()).field;
+                    if (ImGui::Selectable(name.c_str(), name == field))
+                        field = name;
+                }
+                ImGui::EndCombo();
+            };
+            if (ImGui::Checkbox("Sweep grid", &sweepGrid) && sweepGrid && sweepFieldX.empty() && sweepFieldY.empty()
+                && material.reflected()) {
+                std::vector<std::string> names;
+                for (const ParameterField &field : material.layout.fields)
+                    if (MaterialSweep::sweepable(field))
+                        names.push_back(MaterialSweep::axis(field, material.data.data()).field);
+                if (names.size() > 0)
+                    sweepFieldX = names[0];
+                if (names.size() > 1)
+                    sweepFieldY = names[1];
             }
+            if (sweepGrid) {
+                ImGui::SliderInt("Columns", &sweepColumns, 1, MAX_SWEEP_CELLS);
+                ImGui::SliderInt("Rows", &sweepRows, 1, MAX_SWEEP_CELLS);
+                sweepCombo("Across columns", sweepFieldX);
+                sweepCombo("Across rows", sweepFieldY);
+                if (showScene)
+                    ImGui::TextDisabled("Not available for glTF scenes");
+                else
+                    ImGui::TextDisabled("%d cells in one instanced draw, %.3f ms GPU", sweep.count(), sweepTimer.milliseconds());
+            }
+
+            if (ImGui::Button("Bake") && material.reflected()) {
+                std::string materialConstant = material.constructor("MaterialData");
+                if (!materialConstant.empty()) {
+                    // Light colors become vec3[MAX_LIGHTS] array constructors
+                    auto lightColors = [&](glm::vec4 FrameLight::*color) {
+                        std::string colors = "vec3[" + std::to_string(MAX_LIGHTS) + "](";
+                        for (int i = 0; i < MAX_LIGHTS; i++)
+                            colors += (i ? ", " : "") + ParameterBlock::literal(GL_FLOAT_VEC3, glm::value_ptr(frameData.lights[i].*color));
+                        return colors + ")";
+                    };
+
+                    ShaderDefines defines = variantDefines;
+                    defines["BAKED_MATERIAL"] = materialConstant;
+                    defines["BAKED_LIGHTS"] = "";
+                    defines["BAKED_LIGHT_DIFFUSE"] = lightColors(&FrameLight::diffuse);
+                    defines["BAKED_LIGHT_SPECULAR"] = lightColors(&FrameLight::specular);
+                    defines["BAKED_LIGHT_AMBIENT"] = lightColors(&FrameLight::ambient);
+
+                    dropBake();
+                    bakedShader = shadingModels[currentShader]->build(defines);
+                }
+            }
+            ImGui::SameLine();
+            if (!bakedShader)
+                ImGui::TextDisabled("Live parameters");
+            else if (bakedShader->state == ShaderState::Failed)
+                ImGui::TextDisabled("Bake failed, see console");
+            else if (!bakedShader->ready())
+                ImGui::TextDisabled("Baking...");
+            else
+                ImGui::Text("Baked constants");
             ImGui::End();
         }
 
@@ -398,11 +1218,20 @@ int main() {
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         glfwSwapBuffers(window);
+        GpuArena::instance().endFrame();
+
+        if (firstFrame) {
+            glFinish();
+            std::cout << "Time to first frame: " << glfwGetTime() * 1000.0 << " ms (program cache "
+            << (ProgramCache::supported() ? (ProgramCache::misses == 0 ? "warm" : "cold") : "unsupported")
+            << ", " << ProgramCache::hits << " hits, " << ProgramCache::misses << " misses)" << std::endl;
+            firstFrame = false;
+        }
         glfwPollEvents();
     }
 
-    glfwTerminate();
-    return 0;
+    if (tangentNormalMap)
+        glDeleteTextures(1, &tangentNormalMap);
 }
 
 
@@ -7,57 +7,77 @@ struct Material {
     float ao;
 };
 
-struct Light {
-    vec3 position;
-    vec3 color;
-};
-
 out vec4 FragColor;
 
 in vec3 WorldPos;
 in vec2 TexCoords;
 in vec3 Normal;
+in vec4 Tangent;
+
+#include "include/frame.glsl"
 
-uniform vec3 CameraPos;
 uniform Material material;
-uniform Light lights[2];
 
+// Each map is enabled by its own define and scaled by the material factors, as in glTF.
+// The metallic-roughness map holds roughness in green and metallic in blue.
+#ifdef ALBEDO_MAP
 uniform sampler2D albedoMap;
+#endif
+#ifdef METALLIC_ROUGHNESS_MAP
+uniform sampler2D metallicRoughnessMap;
+#endif
+#ifdef NORMAL_MAP
 uniform sampler2D normalMap;
-uniform sampler2D metallicMap;
-uniform sampler2D roughnessMap;
+// Set by Mesh::draw for meshes with tangents, the others rebuild the basis from derivatives.
+// DERIVATIVE_TBN always does, to compare the two.
+uniform bool vertexTangents;
+#endif
 
 const float PI = 3.14159265359;
 
+#ifdef NORMAL_MAP
 vec3 getNormalFromMap();
+#endif
 vec3 fresnelSchlick(float cosTheta, vec3 F0);
 float DistributionGGX(vec3 N, vec3 H, float roughness);
 float GeometrySchlickGGX(float NdotV, float roughness);
 float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
 
 void main() {
-    vec3 albedo = pow(texture(albedoMap, TexCoords).rgb, vec3(2.2));
+    vec3 albedo = material.albedo;
+    float metallic = material.metallic;
+    float roughness = material.roughness;
+#ifdef ALBEDO_MAP
+    albedo *= pow(texture(albedoMap, TexCoords).rgb, vec3(2.2));
+#endif
+#ifdef METALLIC_ROUGHNESS_MAP
+    vec4 metallicRoughness = texture(metallicRoughnessMap, TexCoords);
+    metallic *= metallicRoughness.b;
+    roughness *= metallicRoughness.g;
+#endif
+#ifdef NORMAL_MAP
     vec3 normal = getNormalFromMap();
-    float metallic = texture(metallicMap, TexCoords).r;
-    float roughness = texture(roughnessMap, TexCoords).r;
+#else
+    vec3 normal = normalize(Normal);
+#endif
 
-    vec3 viewDir = normalize(CameraPos - WorldPos);
+    vec3 viewDir = normalize(cameraPos.xyz - WorldPos);
 
     vec3 F0 = vec3(0.04);
-    F0 = mix(F0, albedo, material.metallic);
+    F0 = mix(F0, albedo, metallic);
 
     vec3 L = vec3(0.0); // The total light reflected towards the camera
 
-    for (int i = 0; i < 2; i++) {
+    for (int i = 0; i < lightCount; i++) {
 
         // Radiance calculations
-        vec3 lightDir = normalize(lights[i].position - WorldPos);
+        vec3 lightDir = normalize(lights[i].position.xyz - WorldPos);
         vec3 halfwayDir = normalize(viewDir + lightDir);
 
-        float distance = distance(WorldPos, lights[i].position);
+        float distance = distance(WorldPos, lights[i].position.xyz);
         float attenuation = 1.0 / (distance * distance);
 
-        vec3 radiance = lights[i].color * attenuation;
+        vec3 radiance = lightDiffuse(i) * attenuation;
 
         // Cook-Torrance BRDF
         vec3 fresnel = fresnelSchlick(max(dot(halfwayDir, normal), 0.0), F0);
@@ -129,9 +149,18 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
     return ggx1 * ggx2;
 }
 
+#ifdef NORMAL_MAP
 vec3 getNormalFromMap() {
     vec3 tangentNormal = texture(normalMap, TexCoords).xyz * 2.0 - 1.0;
 
+#ifndef DERIVATIVE_TBN
+    // MikkTSpace: the interpolated vectors are used as they are, only the result is normalized
+    if (vertexTangents) {
+        vec3 bitangent = (Tangent.w < 0.0 ? -1.0 : 1.0) * cross(Normal, Tangent.xyz);
+        return normalize(tangentNormal.x * Tangent.xyz + tangentNormal.y * bitangent + tangentNormal.z * Normal);
+    }
+#endif
+
     vec3 Q1  = dFdx(WorldPos);
     vec3 Q2  = dFdy(WorldPos);
     vec2 st1 = dFdx(TexCoords);
@@ -143,4 +172,5 @@ vec3 getNormalFromMap() {
     mat3 TBN = mat3(T, B, N);
 
     return normalize(TBN * tangentNormal);
-}
\ No newline at end of file
+}
+#endif
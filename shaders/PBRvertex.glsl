@@ -1,21 +1,33 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoords;
-layout (location = 2) in vec3 aNormal;
+#include "include/perVertex.glsl"
+
+#include "include/vertexInput.glsl"
 
 out vec2 TexCoords;
 
+// Scenes culled on the GPU draw every object as an instance of an indirect command, its
+// world transform is picked by the command's base instance, see SceneCulling
+#ifdef INDIRECT_DRAW
+layout (location = 4) in mat4 instanceModel;    // Locations 4 to 7
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+#include "include/frame.glsl"
 
 out vec3 Normal;
 out vec3 WorldPos;
+out vec4 Tangent;
 
 void main() {
-   WorldPos = vec3(model * vec4(aPos, 1.0));
-   Normal = mat3(transpose(inverse(model))) * aNormal;
+#ifdef INDIRECT_DRAW
+   mat4 model = instanceModel;
+#endif
+   WorldPos = vec3(model * vec4(vertexPosition(), 1.0));
+   Normal = mat3(transpose(inverse(model))) * vertexNormal();
+   vec4 tangent = vertexTangent();
+   Tangent = vec4(mat3(model) * tangent.xyz, tangent.w);
    gl_Position = projection * view * vec4(WorldPos, 1.0);
 
-   TexCoords = aTexCoords;
-}
\ No newline at end of file
+   TexCoords = vertexTexCoord();
+}
@@ -0,0 +1,73 @@
+#version 430 core
+// Frustum culls the draws of a scene and writes the indirect commands of the visible ones,
+// compacted per batch. See SceneCulling.
+layout (local_size_x = 64) in;
+
+struct CullObject {
+    mat4 transform;
+    vec4 boundsMin;     // Mesh bounds before the transform, w unused
+    vec4 boundsMax;
+    uvec4 command;      // Index count, first index, base vertex, batch
+};
+
+layout (std430, binding = 0) readonly buffer Objects {
+    CullObject objects[];
+};
+
+// DrawElementsIndirectCommands, five uints each
+layout (std430, binding = 1) writeonly buffer Commands {
+    uint commands[];
+};
+
+// Per batch: its first command, then the number of visible draws counted here
+layout (std430, binding = 2) readonly buffer Batches {
+    uint batchFirst[];
+};
+
+layout (std430, binding = 3) buffer Counts {
+    uint drawCounts[];
+};
+
+// World transform of every visible object, read as an instanced attribute through the base instance
+layout (std430, binding = 4) writeonly buffer Transforms {
+    mat4 instanceModels[];
+};
+
+uniform mat4 sceneTransform;
+uniform mat4 viewProjection;
+uniform int objectCount;
+
+bool visible(mat4 model, vec3 boundsMin, vec3 boundsMax) {
+    vec3 center = vec3(model * vec4((boundsMin + boundsMax) * 0.5, 1.0));
+    vec3 halfSize = (boundsMax - boundsMin) * 0.5;
+    vec3 extent = abs(model[0].xyz) * halfSize.x + abs(model[1].xyz) * halfSize.y + abs(model[2].xyz) * halfSize.z;
+
+    // Planes of the frustum in world space, left, right, bottom, top, near, far
+    mat4 rows = transpose(viewProjection);
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = rows[3] + (i % 2 == 0 ? rows[i / 2] : -rows[i / 2]);
+        if (dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent) < 0.0)
+            return false;
+    }
+    return true;
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(objectCount))
+        return;
+
+    CullObject object = objects[index];
+    mat4 model = sceneTransform * object.transform;
+    if (!visible(model, object.boundsMin.xyz, object.boundsMax.xyz))
+        return;
+
+    uint batch = object.command.w;
+    uint slot = (batchFirst[batch] + atomicAdd(drawCounts[batch], 1u)) * 5u;
+    commands[slot] = object.command.x;
+    commands[slot + 1u] = 1u;
+    commands[slot + 2u] = object.command.y;
+    commands[slot + 3u] = object.command.z;
+    commands[slot + 4u] = index;
+    instanceModels[index] = model;
+}
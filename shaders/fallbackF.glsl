@@ -0,0 +1,14 @@
+#version 330
+out vec4 FragColor;
+
+#include "include/frame.glsl"
+#include "include/surface.glsl"
+
+// Cheap grey shading drawn while the selected shading model is still compiling
+void main() {
+    vec3 normal = normalize(Normal);
+    vec3 lightDir = normalize(lights[0].position.xyz - WorldPos);
+    float shade = 0.2 + 0.6 * max(dot(lightDir, normal), 0.0);
+
+    FragColor = vec4(vec3(shade), 1.0);
+}
@@ -0,0 +1,35 @@
+// Per-frame camera and lights, written once per frame into the FrameData uniform buffer
+struct Light {
+    vec4 position;
+    vec4 diffuse;   // @color @default 1.0 1.0 1.0
+    vec4 specular;  // @color @default 1.0 1.0 1.0
+    vec4 ambient;   // @color @default 0.1 0.1 0.1
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 cameraPos;
+    Light lights[2];
+};
+
+// Light colors, baked shaders receive them as constant arrays
+#ifdef BAKED_LIGHTS
+const vec3 bakedDiffuse[2] = BAKED_LIGHT_DIFFUSE;
+const vec3 bakedSpecular[2] = BAKED_LIGHT_SPECULAR;
+const vec3 bakedAmbient[2] = BAKED_LIGHT_AMBIENT;
+
+vec3 lightDiffuse(int i) { return bakedDiffuse[i]; }
+vec3 lightSpecular(int i) { return bakedSpecular[i]; }
+vec3 lightAmbient(int i) { return bakedAmbient[i]; }
+#else
+vec3 lightDiffuse(int i) { return lights[i].diffuse.rgb; }
+vec3 lightSpecular(int i) { return lights[i].specular.rgb; }
+vec3 lightAmbient(int i) { return lights[i].ambient.rgb; }
+#endif
+
+#ifdef NUM_LIGHTS
+const int lightCount = NUM_LIGHTS;
+#else
+uniform int lightCount;
+#endif
@@ -0,0 +1,29 @@
+// Declares "material" from the MaterialData struct defined by the including shader. Baked
+// shaders receive the values as a constant instead of reading the Material block.
+#ifdef BAKED_MATERIAL
+const MaterialData material = BAKED_MATERIAL;
+#else
+layout (std140) uniform Material {
+    MaterialData material;
+};
+#endif
+
+// In a material sweep the members named by SWEEP_X_FIELD and SWEEP_Y_FIELD come from the
+// instance instead of the block, SWEEP_*_SWIZZLE picks x for floats and xyz for colors
+#ifdef MATERIAL_SWEEP
+flat in vec4 SweepX;
+flat in vec4 SweepY;
+
+MaterialData sweptMaterial() {
+    MaterialData swept = material;
+#ifdef SWEEP_X_FIELD
+    swept.SWEEP_X_FIELD = SweepX.SWEEP_X_SWIZZLE;
+#endif
+#ifdef SWEEP_Y_FIELD
+    swept.SWEEP_Y_FIELD = SweepY.SWEEP_Y_SWIZZLE;
+#endif
+    return swept;
+}
+
+#define material sweptMaterial()
+#endif
@@ -0,0 +1,7 @@
+// Separable programs have to redeclare the built-in outputs they write
+#ifdef GL_ARB_separate_shader_objects
+#extension GL_ARB_separate_shader_objects : enable
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+#endif
@@ -0,0 +1,9 @@
+// Annotations after a member drive the generated GUI: @color, @range min max, @default values
+struct MaterialData {
+    vec3 specularReflection;    // @color @default 1.0 1.0 1.0
+    vec3 diffuseReflection;     // @color @default 0.6 0.3 0.7
+    vec3 ambientReflection;     // @color @default 0.2 0.1 0.3
+    float shininess;            // @range 1 128 @default 32
+};
+
+#include "materialBlock.glsl"
@@ -0,0 +1,23 @@
+// Inputs written by surfaceV.glsl and the normal used for shading
+in vec2 TexCoord;
+in vec3 Normal;
+flat in vec3 NormalFlat;
+in vec3 WorldPos;
+
+#if !defined(FLAT_NORMALS) && !defined(SMOOTH_NORMALS)
+uniform bool interpolation;
+#endif
+
+vec3 surfaceNormal() {
+#if defined(FLAT_NORMALS)
+    return normalize(NormalFlat);
+#elif defined(SMOOTH_NORMALS)
+    return normalize(Normal);
+#else
+    if (interpolation) {
+        return normalize(Normal);
+    } else {
+        return normalize(NormalFlat);
+    }
+#endif
+}
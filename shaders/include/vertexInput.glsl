@@ -0,0 +1,51 @@
+// Vertex attributes of every Mesh vertex format, see VertexFormat in Mesh.h
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec4 aTangent;     // Compact formats: the packed angle and handedness in x
+
+// Decode parameters set by Mesh::draw. Compact positions and uvs are stored relative to
+// the mesh bounds, compact normals are octahedral encoded in two components.
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform vec4 texCoordTransform;     // xy scale, zw offset
+uniform bool octahedralNormals;
+
+vec3 vertexPosition() {
+    return aPos * positionScale + positionOffset;
+}
+
+vec2 vertexTexCoord() {
+    return aTexCoord * texCoordTransform.xy + texCoordTransform.zw;
+}
+
+vec3 vertexNormal() {
+    if (!octahedralNormals)
+        return aNormal;
+
+    vec3 normal = vec3(aNormal.xy, 1.0 - abs(aNormal.x) - abs(aNormal.y));
+    if (normal.z < 0.0)
+        normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(normal);
+}
+
+// Same basis as tangentBasis() in Mesh.cpp, packed tangents are an angle in it
+void tangentBasis(vec3 normal, out vec3 b1, out vec3 b2) {
+    float side = normal.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (side + normal.z);
+    float b = normal.x * normal.y * a;
+    b1 = vec3(1.0 + side * normal.x * normal.x * a, side * b, -side * normal.x);
+    b2 = vec3(b, side + normal.y * normal.y * a, -normal.y);
+}
+
+// xyz tangent, w handedness of the bitangent. Only meaningful for meshes with tangents.
+vec4 vertexTangent() {
+    if (!octahedralNormals)
+        return aTangent;
+
+    vec3 b1, b2;
+    tangentBasis(vertexNormal(), b1, b2);
+    float bits = aTangent.x;
+    float angle = mod(bits, 32768.0) * (6.28318530718 / 32768.0);
+    return vec4(cos(angle) * b1 + sin(angle) * b2, bits >= 32768.0 ? -1.0 : 1.0);
+}
@@ -1,38 +1,25 @@
 #version 330
 out vec4 FragColor;
-in vec2 TexCoord;
-in vec3 Normal;
-flat in vec3 NormalFlat;
-in vec3 WorldPos;
 
-struct Light {
-    vec3 position;
-    vec3 color;
-};
+#include "include/frame.glsl"
+#include "include/surface.glsl"
 
-struct Material {
-    vec3 color;
-    float albedo;
+struct MaterialData {
+    vec3 color;     // @color @default 0.6 0.3 0.7
+    float albedo;   // @range 0 1 @default 0.8
 };
 
-uniform Light lights[2];
-uniform Material material;
-uniform bool interpolation;
+#include "include/materialBlock.glsl"
 
 void main() {
     vec3 color = vec3(0);
 
-    vec3 normal;
-    if (interpolation) {
-        normal = normalize(Normal);
-    } else {
-        normal = normalize(NormalFlat);
-    }
+    vec3 normal = surfaceNormal();
 
-    for (int i = 0; i < lights.length(); i++) {
-        vec3 lightDir = normalize(lights[i].position - WorldPos);
+    for (int i = 0; i < lightCount; i++) {
+        vec3 lightDir = normalize(lights[i].position.xyz - WorldPos);
         float scalar = max(dot(lightDir, normal), 0.0); // Lambert's Cosine Law
-        color += material.albedo * material.color * scalar * lights[i].color;
+        color += material.albedo * material.color * scalar * lightDiffuse(i);
     }
     
     FragColor = vec4(color, 1.0);
@@ -1,14 +1,15 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-//layout (location = 1) in vec2 aTexCoord;
+#include "include/perVertex.glsl"
+
+#include "include/vertexInput.glsl"
 
 //out vec2 TexCoord;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "include/frame.glsl"
 
 void main() {
-   gl_Position = projection * view * model * vec4(aPos, 1.0);
+   gl_Position = projection * view * model * vec4(vertexPosition(), 1.0);
 //   TexCoord = aTexCoord;
 }
\ No newline at end of file
@@ -1,24 +1,15 @@
 #version 330
 out vec4 FragColor;
-in vec2 TexCoord;
-in vec3 Normal;
-flat in vec3 NormalFlat;
-in vec3 WorldPos;
-
-struct Light {
-    vec3 position;
-    vec3 intensity;
-};
 
-struct Material {
-    float albedo;
-    float roughness;
+#include "include/frame.glsl"
+#include "include/surface.glsl"
+
+struct MaterialData {
+    float albedo;       // @range 0 1 @default 0.8
+    float roughness;    // @range 0 1 @default 0
 };
 
-uniform Light lights[2];
-uniform Material material;
-uniform vec3 cameraPos;
-uniform bool interpolation;
+#include "include/materialBlock.glsl"
 
 float PI = 3.14159265359;
 
@@ -27,20 +18,15 @@ void main() {
     vec3 diffuse = vec3(0);
     vec3 ambient = vec3(0);
 
-    vec3 normal;
-    if (interpolation) {
-        normal = normalize(Normal);
-    } else {
-        normal = normalize(NormalFlat);
-    }
+    vec3 normal = surfaceNormal();
 
-    vec3 viewDir = normalize(cameraPos - WorldPos);
+    vec3 viewDir = normalize(cameraPos.xyz - WorldPos);
 
     float normalDotViewDir = clamp(dot(normal, viewDir), 0.000001, 1.0);
     float angleVN = acos(normalDotViewDir);
 
-    for (int i = 0; i < lights.length(); i++) {
-        vec3 lightDir = normalize(lights[i].position - WorldPos);
+    for (int i = 0; i < lightCount; i++) {
+        vec3 lightDir = normalize(lights[i].position.xyz - WorldPos);
 
         float normalDotLightDir = clamp(dot(normal, lightDir), 0.000001, 1.0);
         float angleLN = acos(normalDotLightDir);
@@ -59,7 +45,7 @@ void main() {
 
         float orenNayar = (material.albedo / PI) * normalDotLightDir * (A + (B * max(0.0, gamma) * sin(alpha) * tan(beta)));
 
-        diffuse += orenNayar * lights[i].intensity;
+        diffuse += orenNayar * lightDiffuse(i);
     }
 
     diffuse = pow(diffuse, vec3(1.0 / 2.2));
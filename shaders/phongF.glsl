@@ -1,52 +1,28 @@
 #version 330
 out vec4 FragColor;
-in vec2 TexCoord;
-in vec3 Normal;
-flat in vec3 NormalFlat;
-in vec3 WorldPos;
-
-struct Light {
-    vec3 position;
-    vec3 specularIntensity;
-    vec3 diffuseIntensity;
-    vec3 ambientIntensity;
-};
-
-struct Material {
-    vec3 specularReflection;
-    vec3 diffuseReflection; // Lambertian reflection
-    vec3 ambientReflection;
-    float shininess;
-};
-
-uniform Light lights[2];
-uniform Material material;
-uniform vec3 cameraPos;
-uniform bool interpolation;
+
+#include "include/frame.glsl"
+#include "include/surface.glsl"
+#include "include/phongMaterial.glsl"
 
 void main() {
-    vec3 normal;
-    if (interpolation) {
-        normal = normalize(Normal);
-    } else {
-        normal = normalize(NormalFlat);
-    }
+    vec3 normal = surfaceNormal();
 
     vec3 specular = vec3(0);
     vec3 diffuse = vec3(0);
     vec3 ambient = vec3(0);
 
-    vec3 viewDir = normalize(cameraPos - WorldPos);
+    vec3 viewDir = normalize(cameraPos.xyz - WorldPos);
 
-    for (int i = 0; i < lights.length(); i++) {
-        vec3 lightDir = normalize(lights[i].position - WorldPos);
+    for (int i = 0; i < lightCount; i++) {
+        vec3 lightDir = normalize(lights[i].position.xyz - WorldPos);
 
         vec3 reflectionDir = reflect(lightDir, normal);
         float cosTheta = max(dot(lightDir, normal), 0.0); // Lambert's Cosine Law
 
-        ambient += lights[i].ambientIntensity * material.ambientReflection;
-        diffuse += cosTheta * material.diffuseReflection * lights[i].diffuseIntensity;
-        specular += material.specularReflection * pow(max(dot(viewDir, reflectionDir), 0.0), material.shininess) * lights[i].specularIntensity;
+        ambient += lightAmbient(i) * material.ambientReflection;
+        diffuse += cosTheta * material.diffuseReflection * lightDiffuse(i);
+        specular += material.specularReflection * pow(max(dot(viewDir, reflectionDir), 0.0), material.shininess) * lightSpecular(i);
     }
 
     FragColor = vec4(vec3(ambient + diffuse + specular), 1.0);
@@ -1,21 +0,0 @@
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoord;
-layout (location = 2) in vec3 aNormal;
-
-out vec2 TexCoord;
-out vec3 Normal;
-flat out vec3 NormalFlat;
-out vec3 WorldPos;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    WorldPos = vec3(model * vec4(aPos, 1.0));
-    TexCoord = aTexCoord;
-    Normal = aNormal;
-    NormalFlat = aNormal;
-}
\ No newline at end of file
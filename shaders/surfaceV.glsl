@@ -0,0 +1,39 @@
+#version 330 core
+#include "include/perVertex.glsl"
+
+#include "include/vertexInput.glsl"
+
+out vec2 TexCoord;
+out vec3 Normal;
+flat out vec3 NormalFlat;
+out vec3 WorldPos;
+
+// A material sweep draws its whole grid as instances, each with its own transform and the
+// values of the swept material members, see MaterialSweep
+#ifdef MATERIAL_SWEEP
+layout (location = 4) in mat4 instanceModel;    // Locations 4 to 7
+layout (location = 8) in vec4 instanceSweepX;
+layout (location = 9) in vec4 instanceSweepY;
+flat out vec4 SweepX;
+flat out vec4 SweepY;
+#else
+uniform mat4 model;
+#endif
+
+#include "include/frame.glsl"
+
+void main() {
+#ifdef MATERIAL_SWEEP
+    mat4 model = instanceModel;
+    SweepX = instanceSweepX;
+    SweepY = instanceSweepY;
+#endif
+    vec3 position = vertexPosition();
+    vec3 normal = vertexNormal();
+
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    WorldPos = vec3(model * vec4(position, 1.0));
+    TexCoord = vertexTexCoord();
+    Normal = normal;
+    NormalFlat = normal;
+}